@@ -0,0 +1,69 @@
+#include "index.hpp"
+#include "predicates.hpp"
+#include "../singleJoin/sortMerge.hpp"
+#include <algorithm>
+
+char secondaryIndexes = INDEX_LAZY;
+
+uint64_t indexBytes = 0;
+
+// The secondary index of column 'col' of 'rel': the (value, rowid) pairs of
+// the column sorted by value. It is built the first time it is asked for.
+// The sort is stable, so the rowids of equal values stay in table order
+Column * columnIndex(Relation * rel, uint64_t relIndex, uint64_t col){
+    if(rel->index[col] != NULL)
+        return rel->index[col];
+
+    TIMEVAR startTime = currentTime();
+
+    Column * pairs = newAlignedColumn(rel->rows);
+    for(uint64_t i=0; i<rel->rows; i++){
+        pairs->value[i] = rel->data[col][i];
+        pairs->rowid[i] = i;
+    }
+    Column * index = newAlignedColumn(rel->rows);
+    radixSortRun(pairs, index, 0, rel->rows);
+    deleteColumn(pairs);
+
+    rel->index[col] = index;
+    uint64_t bytes = 2 * rel->rows * sizeof(uint64_t);
+    indexBytes += bytes;
+
+    std::cerr << "Index: " << relIndex << "." << col
+    << " (" << ((double)(currentTime() - startTime))/1000000
+    << " seconds, " << bytes / 1024 << " KB, "
+    << indexBytes / 1024 << " KB in all indexes)" << '\n';
+
+    return index;
+}
+
+// Builds the index of every column of every relation up front
+void buildAllIndexes(Relation * r, uint64_t relationsSize){
+    for(uint64_t i=0; i<relationsSize; i++)
+        for(uint64_t j=0; j<r[i].cols; j++)
+            columnIndex(&r[i], i, j);
+}
+
+// Finds the run of 'index' whose values compare to 'value' with 'op'.
+// Returns its length and sets *first to where it starts
+uint64_t indexLookup(Column * index, char op, uint64_t value,
+                     uint64_t * first){
+    uint64_t * begin = index->value;
+    uint64_t * end = index->value + index->size;
+    uint64_t * low = begin;
+    uint64_t * high = end;
+
+    if(op == '<'){
+        high = std::lower_bound(begin, end, value);
+    }
+    else if(op == '>'){
+        low = std::upper_bound(begin, end, value);
+    }
+    else{
+        low = std::lower_bound(begin, end, value);
+        high = std::upper_bound(low, end, value);
+    }
+
+    *first = low - begin;
+    return high - low;
+}
@@ -0,0 +1,26 @@
+#include "memmap.hpp"
+
+#ifndef INDEX_HPP
+#define INDEX_HPP
+
+// A filter whose most selective term is estimated to keep less than
+// INDEX_SELECTIVITY of the rows looks that term up in the secondary index of
+// its column instead of scanning the column
+#define INDEX_SELECTIVITY 0.01
+
+// When secondary indexes are built, see the --index option
+#define INDEX_OFF 0
+#define INDEX_LAZY 1
+#define INDEX_EAGER 2
+
+extern char secondaryIndexes;
+
+// Memory taken by all the secondary indexes built so far
+extern uint64_t indexBytes;
+
+Column * columnIndex(Relation * rel, uint64_t relIndex, uint64_t col);
+void buildAllIndexes(Relation * r, uint64_t relationsSize);
+uint64_t indexLookup(Column * index, char op, uint64_t value,
+                     uint64_t * first);
+
+#endif
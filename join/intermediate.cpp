@@ -1,6 +1,8 @@
 #include "intermediate.hpp"
+#include "../threads/scheduler.hpp"
 
 extern Relation * r;
+extern JobScheduler * myJobScheduler;
 
 // Construct a Column struct from a given column in a Result data structure
 // VERY IMPORTANT: RowIDs start from 1.
@@ -31,15 +33,14 @@ Column * construct(Intermediate * IR,
                    uint64_t relColumn,
                    uint64_t * queryRelations){
 
-    Column * constructed = newColumn(IR->length);
+    Column * constructed = newAlignedColumn(IR->length);
 
-    for(uint64_t i=0; i<IR->length; i++){
+    for(uint64_t i=0; i<IR->length; i++)
         constructed->rowid[i] = i;
 
-        uint64_t relIndex = queryRelations[relation];
-        uint64_t relRowID = IR->results[relation][i];
-        constructed->value[i] = r[relIndex].data[relColumn][relRowID];
-    }
+    uint64_t relIndex = queryRelations[relation];
+    gatherIntermediateValues(IR, relation, r[relIndex].data[relColumn],
+                             constructed->value);
 
     return constructed;
 }
@@ -61,15 +62,14 @@ SelfJoinColumn * selfJoinConstruct(Intermediate * IR,
     constructed->valueB = new uint64_t[IR->length];
     constructed->size = IR->length;
 
-    for(uint64_t i=0; i<IR->length; i++){
+    for(uint64_t i=0; i<IR->length; i++)
         constructed->rowid[i] = i;
 
-        uint64_t relIndex = queryRelations[relation];
-        uint64_t relRowID = IR->results[relation][i];
-
-        constructed->valueA[i] = r[relIndex].data[relColumnA][relRowID];
-        constructed->valueB[i] = r[relIndex].data[relColumnB][relRowID];
-    }
+    uint64_t relIndex = queryRelations[relation];
+    gatherIntermediateValues(IR, relation, r[relIndex].data[relColumnA],
+                             constructed->valueA);
+    gatherIntermediateValues(IR, relation, r[relIndex].data[relColumnB],
+                             constructed->valueB);
 
     return constructed;
 }
@@ -96,6 +96,48 @@ Column * constructMappedData(uint64_t relIndex,
     return constructed;
 }
 
+// Like constructMappedData, but only the tuples that pass the Bloom filter
+// are kept, so the column owns copies of both its values and rowids
+Column * constructBloomMappedData(uint64_t relIndex,
+                                  uint64_t column,
+                                  uint64_t * queryRelations,
+                                  BloomFilter * filter){
+
+    // Convert relative index to actual index in mapped data
+    relIndex = queryRelations[relIndex];
+
+    uint64_t * values = r[relIndex].data[column];
+    uint64_t rows = r[relIndex].rows;
+
+    // Every job compacts its slice in place, then the slices are moved
+    // next to each other
+    Column * constructed = newAlignedColumn(rows);
+    uint64_t chunk = (rows + BLOOM_SCAN_JOBS - 1) / BLOOM_SCAN_JOBS;
+    uint64_t kept[BLOOM_SCAN_JOBS];
+    int jobs = 0;
+
+    for(uint64_t start=0; start<rows; start+=chunk){
+        uint64_t length = start + chunk > rows ? rows - start : chunk;
+        myJobScheduler->Schedule(new BloomScanJob(filter, values, start, length,
+                                                  constructed, &kept[jobs]));
+        jobs++;
+    }
+    myJobScheduler->Barrier(jobs);
+
+    uint64_t size = 0;
+    for(int i=0; i<jobs; i++){
+        uint64_t start = i * chunk;
+        memmove(constructed->value + size, constructed->value + start,
+                kept[i] * sizeof(uint64_t));
+        memmove(constructed->rowid + size, constructed->rowid + start,
+                kept[i] * sizeof(uint64_t));
+        size += kept[i];
+    }
+    constructed->size = size;
+
+    return constructed;
+}
+
 SelfJoinColumn * selfJoinConstructMappedData(Intermediate * IR,
                                              uint64_t relation,
                                              uint64_t relColumnA,
@@ -119,12 +161,283 @@ SelfJoinColumn * selfJoinConstructMappedData(Intermediate * IR,
     return constructed;
 }
 
-void deleteIntermediate(Intermediate * im){
-    for(uint64_t i=0; i<4; i++){
-        if(im->results[i] != NULL)
-            delete[] im->results[i];
+// An empty IR with room for the 'width' relations of a query
+Intermediate * newIntermediate(uint64_t width){
+    Intermediate * IR = new Intermediate;
+    IR->width = width;
+    IR->results = new uint64_t*[width];
+    IR->live = new uint64_t[width];
+    for(uint64_t i=0; i<width; i++)
+        IR->results[i] = NULL;
+    IR->liveCount = 0;
+    IR->length = 0;
+    IR->selection = NULL;
+    IR->physicalLength = 0;
+    IR->factorRel = width;
+    IR->factorStart = NULL;
+    IR->factorCount = NULL;
+    IR->factorRowids = NULL;
+    IR->factorSize = 0;
+
+    return IR;
+}
+
+// Gives 'relation' the column 'rowids', which the IR owns from now on. A
+// column the relation already had is replaced
+void setIntermediateColumn(Intermediate * IR, uint64_t relation,
+                           uint64_t * rowids){
+    if(IR->results[relation] == NULL)
+        IR->live[IR->liveCount++] = relation;
+    else
+        delete[] IR->results[relation];
+
+    IR->results[relation] = rowids;
+}
+
+// Replaces every live column with the IR rows 'rows[0..newLength)'. The rows
+// are split in morsels that rewrite all the columns in parallel. A pending
+// selection is applied on the way, so the new columns are always dense.
+// The groups of a factorized IR follow their rows like two more columns
+void gatherIntermediate(Intermediate * IR, uint64_t * rows, uint64_t newLength){
+    uint64_t columns = IR->liveCount + (isFactorized(IR) ? 2 : 0);
+    uint64_t ** from = new uint64_t*[columns];
+    uint64_t ** to = new uint64_t*[columns];
+    for(uint64_t c=0; c<IR->liveCount; c++)
+        from[c] = IR->results[IR->live[c]];
+    if(isFactorized(IR)){
+        from[IR->liveCount] = IR->factorStart;
+        from[IR->liveCount + 1] = IR->factorCount;
     }
+    for(uint64_t c=0; c<columns; c++)
+        to[c] = new uint64_t[newLength];
+
+    if(newLength <= IR_MORSEL){
+        GatherIRJob job(from, to, columns, IR->selection, rows, 0, newLength);
+        job.Run();
+    }
+    else{
+        int jobs = 0;
+        for(uint64_t start=0; start<newLength; start+=IR_MORSEL){
+            uint64_t length = start + IR_MORSEL > newLength ? newLength - start
+                                                             : IR_MORSEL;
+            myJobScheduler->Schedule(new GatherIRJob(from, to, columns,
+                                                     IR->selection, rows,
+                                                     start, length));
+            jobs++;
+        }
+        myJobScheduler->Barrier(jobs);
+    }
+
+    for(uint64_t c=0; c<columns; c++)
+        delete[] from[c];
+    for(uint64_t c=0; c<IR->liveCount; c++)
+        IR->results[IR->live[c]] = to[c];
+    if(isFactorized(IR)){
+        IR->factorStart = to[IR->liveCount];
+        IR->factorCount = to[IR->liveCount + 1];
+    }
+    delete[] from;
+    delete[] to;
+
+    delete[] IR->selection;
+    IR->selection = NULL;
+}
+
+// Runs the ValueGatherJobs of one column over all the rows of the IR and
+// returns the sum of their values when they are not written to 'out'
+static uint64_t runValueGather(Intermediate * IR, uint64_t relation,
+                               uint64_t * values, uint64_t * weights,
+                               uint64_t * out){
+    uint64_t * rowids = IR->results[relation];
+    uint64_t jobs = (IR->length + IR_MORSEL - 1) / IR_MORSEL;
+    uint64_t * sums = new uint64_t[jobs > 0 ? jobs : 1];
+
+    if(jobs <= 1){
+        sums[0] = 0;
+        ValueGatherJob job(values, rowids, IR->selection, weights, 0,
+                           IR->length, out, &sums[0]);
+        job.Run();
+        jobs = 1;
+    }
+    else{
+        for(uint64_t j=0; j<jobs; j++){
+            uint64_t start = j * IR_MORSEL;
+            uint64_t length = start + IR_MORSEL > IR->length ? IR->length - start
+                                                              : IR_MORSEL;
+            myJobScheduler->Schedule(new ValueGatherJob(values, rowids,
+                                                        IR->selection, weights,
+                                                        start, length, out,
+                                                        &sums[j]));
+        }
+        myJobScheduler->Barrier((int) jobs);
+    }
+
+    uint64_t total = 0;
+    if(out == NULL)
+        for(uint64_t j=0; j<jobs; j++)
+            total += sums[j];
+    delete[] sums;
 
+    return total;
+}
+
+// Writes to out[i] the value in 'values' of the tuple of 'relation' that is
+// on row i of the IR
+void gatherIntermediateValues(Intermediate * IR, uint64_t relation,
+                              uint64_t * values, uint64_t * out){
+    runValueGather(IR, relation, values, NULL, out);
+}
+
+// Sum of the values of 'relation' over the rows of the IR, which weigh as
+// much as their groups when the IR is factorized. 'relation' must not be
+// the factorized one
+uint64_t sumIntermediateValues(Intermediate * IR, uint64_t relation,
+                               uint64_t * values){
+    uint64_t * weights = isFactorized(IR) ? IR->factorCount : NULL;
+    return runValueGather(IR, relation, values, weights, NULL);
+}
+
+// Keeps only the IR rows 'rows[0..newLength)', which the IR takes over.
+// While enough rows are left they are just recorded in the selection,
+// otherwise the columns are compacted right away
+void selectIntermediate(Intermediate * IR, uint64_t * rows, uint64_t newLength){
+    if(IR->selection == NULL){
+        IR->physicalLength = IR->length;
+    }
+    else{
+        for(uint64_t i=0; i<newLength; i++)
+            rows[i] = IR->selection[rows[i]];
+        delete[] IR->selection;
+    }
+    IR->selection = rows;
+    IR->length = newLength;
+
+    if(newLength * SELECTION_COMPACT_RATIO < IR->physicalLength)
+        compactIntermediate(IR);
+}
+
+// Applies a pending selection to the columns
+void compactIntermediate(Intermediate * IR){
+    if(IR->selection == NULL) return;
+
+    uint64_t * rows = IR->selection;
+    IR->selection = NULL;
+    gatherIntermediate(IR, rows, IR->length);
+    delete[] rows;
+}
+
+// Joins 'relation' to the IR without flattening the matches. Match k joined
+// IR row rows[k] with the tuple rowids[k] of the relation. The matches of
+// every IR row become its group and rows without any are dropped, so only
+// the surviving rows are copied instead of one row per match. The IR takes
+// over both arrays. It must not be factorized already
+void factorizeIntermediate(Intermediate * IR, uint64_t relation,
+                           uint64_t * rows, uint64_t * rowids, uint64_t size){
+    uint64_t * cursor = new uint64_t[IR->length]();
+    for(uint64_t k=0; k<size; k++)
+        cursor[rows[k]]++;
+
+    uint64_t kept = 0;
+    for(uint64_t i=0; i<IR->length; i++)
+        if(cursor[i] != 0) kept++;
+
+    // Groups are laid out in the order of their rows. Afterwards 'cursor'
+    // holds where the next member of every group goes
+    uint64_t * keep = new uint64_t[kept];
+    uint64_t * start = new uint64_t[kept];
+    uint64_t * count = new uint64_t[kept];
+    uint64_t pos = 0;
+    uint64_t j = 0;
+    for(uint64_t i=0; i<IR->length; i++){
+        if(cursor[i] == 0) continue;
+        keep[j] = i;
+        start[j] = pos;
+        count[j] = cursor[i];
+        cursor[i] = pos;
+        pos += count[j];
+        j++;
+    }
+
+    uint64_t * members = new uint64_t[size];
+    for(uint64_t k=0; k<size; k++)
+        members[cursor[rows[k]]++] = rowids[k];
+    delete[] cursor;
+    delete[] rows;
+    delete[] rowids;
+
+    gatherIntermediate(IR, keep, kept);
+    delete[] keep;
+
+    IR->length = kept;
+    IR->factorRel = relation;
+    IR->factorStart = start;
+    IR->factorCount = count;
+    IR->factorRowids = members;
+    IR->factorSize = size;
+}
+
+// Expands every row of a factorized IR into one row per member of its
+// group and gives the factorized relation a column again
+void flattenIntermediate(Intermediate * IR){
+    if(!isFactorized(IR)) return;
+
+    uint64_t total = 0;
+    for(uint64_t i=0; i<IR->length; i++)
+        total += factorWeight(IR, i);
+
+    uint64_t * rows = new uint64_t[total];
+    uint64_t * flat = new uint64_t[total];
+    uint64_t pos = 0;
+    for(uint64_t i=0; i<IR->length; i++){
+        uint64_t row = intermediateRow(IR, i);
+        uint64_t * group = IR->factorRowids + IR->factorStart[row];
+        for(uint64_t m=0; m<IR->factorCount[row]; m++){
+            rows[pos] = i;
+            flat[pos] = group[m];
+            pos++;
+        }
+    }
+
+    uint64_t relation = IR->factorRel;
+    delete[] IR->factorStart;
+    delete[] IR->factorCount;
+    delete[] IR->factorRowids;
+    IR->factorRel = IR->width;
+    IR->factorStart = NULL;
+    IR->factorCount = NULL;
+    IR->factorRowids = NULL;
+    IR->factorSize = 0;
+
+    gatherIntermediate(IR, rows, total);
+    delete[] rows;
+
+    setIntermediateColumn(IR, relation, flat);
+    IR->length = total;
+
+    std::cerr << "Flatten: " << relation << " (" << total << " entries)" << '\n';
+}
+
+// prefix[k] is the sum of 'values' over the first k group members, so the
+// sum of a group is the difference of the prefixes at its two ends. Sums
+// wrap around like all the others
+uint64_t * factorPrefixSums(Intermediate * IR, uint64_t * values){
+    uint64_t * prefix = new uint64_t[IR->factorSize + 1];
+    prefix[0] = 0;
+    for(uint64_t k=0; k<IR->factorSize; k++)
+        prefix[k + 1] = prefix[k] + values[IR->factorRowids[k]];
+    return prefix;
+}
+
+void deleteIntermediate(Intermediate * im){
+    for(uint64_t i=0; i<im->liveCount; i++)
+        delete[] im->results[im->live[i]];
+
+    delete[] im->results;
+    delete[] im->live;
+    delete[] im->selection;
+    delete[] im->factorStart;
+    delete[] im->factorCount;
+    delete[] im->factorRowids;
     delete im;
 }
 
@@ -207,6 +520,5 @@ uint64_t * resultToArray(Result * res, uint64_t count, uint64_t index){
 }
 
 bool isEmpty(Intermediate * IR){
-    return IR->results[0] == NULL && IR->results[1] == NULL &&
-           IR->results[2] == NULL && IR->results[3] == NULL;
+    return IR->liveCount == 0;
 }
@@ -1,15 +1,60 @@
 #include "../singleJoin/result.hpp"
 #include "../singleJoin/structs.hpp"
+#include "../singleJoin/bloom.hpp"
 #include "memmap.hpp"
 
 #ifndef INTERMEDIATE_HPP
 #define INTERMEDIATE_HPP
 
+// An IR whose rows are left in a selection is compacted as soon as fewer
+// than 1/SELECTION_COMPACT_RATIO of its physical rows are selected
+#define SELECTION_COMPACT_RATIO 4
+
+// A join that is marked for factorization only groups its output when it
+// has at least FACTORIZE_FANOUT matches per IR row on average
+#define FACTORIZE_FANOUT 2
+
+// Rowids of the tuples joined so far, one column per relation of the query.
+// Only the relations listed in 'live' have a column, the others are NULL, so
+// updates run over the joined relations only.
+// Self joins do not copy the columns. They leave the rows that passed in
+// 'selection', and row i of the IR is then row selection[i] of the
+// 'physicalLength' rows of the columns. Without a selection it is NULL.
+// A factorized IR keeps one more relation, 'factorRel', without a column:
+// physical row p is joined with the group of its rowids
+// factorRowids[factorStart[p] .. factorStart[p] + factorCount[p]), and stands
+// for that many rows of the flattened IR. Without a factor 'factorRowids'
+// is NULL
 struct Intermediate{
-    uint64_t * results[4];
+    uint64_t ** results;
+    uint64_t width;
+    uint64_t * live;
+    uint64_t liveCount;
     uint64_t length;
+    uint64_t * selection;
+    uint64_t physicalLength;
+    uint64_t factorRel;
+    uint64_t * factorStart;
+    uint64_t * factorCount;
+    uint64_t * factorRowids;
+    uint64_t factorSize;
 };
 
+// Row of the columns that holds row i of the IR
+inline uint64_t intermediateRow(Intermediate * IR, uint64_t i){
+    return IR->selection == NULL ? i : IR->selection[i];
+}
+
+inline bool isFactorized(Intermediate * IR){
+    return IR->factorRowids != NULL;
+}
+
+// Number of flattened rows that row i of the IR stands for
+inline uint64_t factorWeight(Intermediate * IR, uint64_t i){
+    return IR->factorRowids == NULL ? 1
+                                    : IR->factorCount[intermediateRow(IR, i)];
+}
+
 struct SelfJoinColumn{
     uint64_t * rowid;
     uint64_t * valueA;
@@ -35,6 +80,40 @@ SelfJoinColumn * selfJoinConstructMappedData(Intermediate * IR,
 Column * constructMappedData(uint64_t relIndex,
                              uint64_t column,
                              uint64_t * queryRelations);
+Column * constructBloomMappedData(uint64_t relIndex,
+                                  uint64_t column,
+                                  uint64_t * queryRelations,
+                                  BloomFilter * filter);
+Intermediate * newIntermediate(uint64_t width);
+void setIntermediateColumn(Intermediate * IR, uint64_t relation,
+                           uint64_t * rowids);
+void gatherIntermediate(Intermediate * IR, uint64_t * rows, uint64_t newLength);
+void gatherIntermediateValues(Intermediate * IR, uint64_t relation,
+                              uint64_t * values, uint64_t * out);
+uint64_t sumIntermediateValues(Intermediate * IR, uint64_t relation,
+                               uint64_t * values);
+void selectIntermediate(Intermediate * IR, uint64_t * rows, uint64_t newLength);
+void compactIntermediate(Intermediate * IR);
+void factorizeIntermediate(Intermediate * IR, uint64_t relation,
+                           uint64_t * rows, uint64_t * rowids, uint64_t size);
+void flattenIntermediate(Intermediate * IR);
+uint64_t * factorPrefixSums(Intermediate * IR, uint64_t * values);
+
+// Sum of 'values' over the rows of 'relation' that row i of the IR stands
+// for. The factorized relation needs the prefix sums of its group members
+// from factorPrefixSums, the others are weighted with the size of the group
+inline uint64_t intermediateRowSum(Intermediate * IR, uint64_t relation,
+                                   uint64_t * values, uint64_t * prefix,
+                                   uint64_t i){
+    uint64_t row = intermediateRow(IR, i);
+    if(IR->factorRowids == NULL)
+        return values[IR->results[relation][row]];
+    if(relation == IR->factorRel){
+        uint64_t start = IR->factorStart[row];
+        return prefix[start + IR->factorCount[row]] - prefix[start];
+    }
+    return IR->factorCount[row] * values[IR->results[relation][row]];
+}
 void deleteIntermediate(Intermediate * im);
 void deleteSJC(SelfJoinColumn * sjc);
 
@@ -1,13 +1,24 @@
 #include "memmap.hpp"
+#include "predicates.hpp"
+#include "../threads/scheduler.hpp"
+#include <math.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+extern JobScheduler * myJobScheduler;
+
+char prefaultMode = PREFAULT_POPULATE;
 
 // Returns the size of a file based on the values of the header
 uint64_t getFileSize(uint64_t rows, uint64_t cols){
     return sizeof(uint64_t) * rows * cols + 2 * sizeof(uint64_t);
 }
 
-// A wrapper for mmap. Only requires the file descriptor and a total size
-uint64_t * memmap(int fd, uint64_t size){
-    return (uint64_t*) mmap(NULL,size,PROT_READ,MAP_PRIVATE,fd, 0);
+// A wrapper for mmap. Only requires the file descriptor, a total size and
+// any flags besides MAP_PRIVATE
+uint64_t * memmap(int fd, uint64_t size, int flags){
+    return (uint64_t*) mmap(NULL,size,PROT_READ,MAP_PRIVATE | flags,fd, 0);
 }
 
 // Takes an input of a 1D array and returns an indexed 2D array
@@ -20,23 +31,58 @@ uint64_t ** convertMap(uint64_t * data, uint64_t rows, uint64_t cols){
     return index;
 }
 
-// This function calculates the requiredstatistics (l,u,f,d)
-// for every column in a given relation
-void calculateStats(Relation * rel){
+// Allocates the stats of every column of 'rel' and schedules one StatsJob
+// per chunk of STATS_CHUNK_ZONES zones of each column, and one SampleJob for
+// its histogram. The sketches of the chunks of column c are left in
+// sketches[c], one after the other. Returns the number of jobs scheduled
+uint64_t calculateStats(Relation * rel, uint8_t ** sketches){
     // Allocate arrays for statistics of each column
     rel->l = new double[rel->cols];
     rel->u = new double[rel->cols];
     rel->f = new double[rel->cols];
     rel->d = new double[rel->cols];
 
+    rel->zones = (rel->rows + ZONE_ROWS - 1) / ZONE_ROWS;
+    rel->zoneMin = new uint64_t*[rel->cols];
+    rel->zoneMax = new uint64_t*[rel->cols];
+    rel->histograms = new Histogram[rel->cols];
+
+    uint64_t chunks = (rel->zones + STATS_CHUNK_ZONES - 1) / STATS_CHUNK_ZONES;
+    uint64_t chunkRows = STATS_CHUNK_ZONES * ZONE_ROWS;
+
     for(uint64_t i=0; i<rel->cols; i++){
+        rel->zoneMin[i] = new uint64_t[rel->zones];
+        rel->zoneMax[i] = new uint64_t[rel->zones];
+        sketches[i] = new uint8_t[(chunks + 1) * HLL_REGISTERS]();
+
+        for(uint64_t c=0; c<chunks; c++){
+            uint64_t start = c * chunkRows;
+            uint64_t length = start + chunkRows < rel->rows ? chunkRows
+                                                            : rel->rows - start;
+            uint64_t zone = c * STATS_CHUNK_ZONES;
+            myJobScheduler->Schedule(new StatsJob(rel->data[i], start, length,
+                                                  ZONE_ROWS,
+                                                  rel->zoneMin[i] + zone,
+                                                  rel->zoneMax[i] + zone,
+                                                  sketches[i] + c * HLL_REGISTERS));
+        }
+        myJobScheduler->Schedule(new SampleJob(rel->data[i], rel->rows,
+                                               &rel->histograms[i]));
+    }
+    return (chunks + 1) * rel->cols;
+}
 
-        // Calculate min and max values
-        uint64_t max = rel->data[i][0];
-        uint64_t min = rel->data[i][0];
-        for(uint64_t j=1; j<rel->rows; j++){
-            if(rel->data[i][j] > max) max = rel->data[i][j];
-            if(rel->data[i][j] < min) min = rel->data[i][j];
+// Once the jobs of calculateStats are done, derives the stats (l,u,f,d) of
+// every column of 'rel' from its zones and the merged sketches of its chunks
+void finishStats(Relation * rel, uint8_t ** sketches){
+    uint64_t chunks = (rel->zones + STATS_CHUNK_ZONES - 1) / STATS_CHUNK_ZONES;
+
+    for(uint64_t i=0; i<rel->cols; i++){
+        uint64_t min = rel->zones > 0 ? rel->zoneMin[i][0] : 0;
+        uint64_t max = rel->zones > 0 ? rel->zoneMax[i][0] : 0;
+        for(uint64_t z=1; z<rel->zones; z++){
+            if(rel->zoneMax[i][z] > max) max = rel->zoneMax[i][z];
+            if(rel->zoneMin[i][z] < min) min = rel->zoneMin[i][z];
         }
         rel->l[i] = (double) min;
         rel->u[i] = (double) max;
@@ -44,55 +90,68 @@ void calculateStats(Relation * rel){
         // Calculate total number of values
         rel->f[i] = rel->rows;
 
-        // Initialize and calculate boolean array
-        uint64_t arraySize = rel->u[i] - rel->l[i] + 1;
-        if(arraySize > 50000000) arraySize = 50000000;
-        bool * tempArray = new bool[arraySize];
-        for(uint64_t j=0; j<arraySize; j++){
-            tempArray[j] = false;
-        }
-        for(uint64_t j=0; j<rel->rows; j++){
-            tempArray[(rel->data[i][j] - (uint64_t)rel->l[i]) % arraySize] = true;
-        }
-
-        // Calculate the total number of different values
-        rel->d[i] = 0;
-        for(uint64_t j=0; j<arraySize; j++){
-            if(tempArray[j] == true){
-                rel->d[i]++;
-            }
-        }
-        //
-        // std::cerr << i << ": l=" << rel->l[i]
-        //                << "  u=" << rel->u[i]
-        //                << "  f=" << rel->f[i]
-        //                << "  d=" << rel->d[i] << "\n";
+        // Estimate the number of different values. There are at least one
+        // and at most as many as the values or the domain
+        for(uint64_t c=1; c<chunks; c++)
+            hllMerge(sketches[i], sketches[i] + c * HLL_REGISTERS);
+        double d = round(hllEstimate(sketches[i]));
+        d = d > rel->f[i] ? rel->f[i] : d;
+        d = d > max - min + 1.0 ? max - min + 1.0 : d;
+        rel->d[i] = rel->rows > 0 && d < 1 ? 1 : d;
 
-        delete[] tempArray;
+        delete[] sketches[i];
     }
+}
 
-    // std::cerr << "\n";
+// Reports why 'inputFile' could not be mapped
+static void mapError(const char inputFile[], const char * call){
+    std::cerr << "Error at " << call << " of " << inputFile << ": "
+              << strerror(errno) << '\n';
 }
 
 // Given a file name, this function will create a return a Relation struct
-// containing the number of columns, rows and all the data in a 2D array
+// containing the number of columns, rows and all the data in a 2D array.
+// If the file can not be mapped, data is left NULL
 Relation mapFile(const char inputFile[]){
     Relation rel;
+    rel.rows = 0;
+    rel.cols = 0;
+    rel.data = NULL;
 
     // Open input file
     int fd = open(inputFile, O_RDONLY);
+    if(fd < 0){
+        mapError(inputFile, "open");
+        return rel;
+    }
 
     // Read the number of columns and rows
-    uint64_t * header = memmap(fd, 128);
+    uint64_t * header = memmap(fd, 128, 0);
+    if(header == (uint64_t *) MAP_FAILED){
+        mapError(inputFile, "mmap");
+        close(fd);
+        return rel;
+    }
     rel.rows = header[0];
     rel.cols = header[1];
+    munmap(header, 128);
 
     // Calculate total length and map the whole file
     uint64_t size = getFileSize(rel.rows, rel.cols);
-    uint64_t * data = memmap(fd, size);
+    uint64_t * data = memmap(fd, size,
+                             prefaultMode == PREFAULT_POPULATE ? MAP_POPULATE : 0);
+    if(data == (uint64_t *) MAP_FAILED){
+        mapError(inputFile, "mmap");
+        close(fd);
+        return rel;
+    }
+    if(prefaultMode == PREFAULT_ADVISE)
+        madvise(data, size, MADV_WILLNEED);
     rel.data = convertMap(data+2, rel.rows, rel.cols);
 
-    calculateStats(&rel);
+    rel.index = new Column*[rel.cols];
+    for(uint64_t i=0; i<rel.cols; i++)
+        rel.index[i] = NULL;
 
     close(fd);
     return rel;
@@ -106,6 +165,17 @@ void unmapData(Relation rel){
     delete[] rel.u;
     delete[] rel.f;
     delete[] rel.d;
+    for(uint64_t i=0; i<rel.cols; i++){
+        delete[] rel.zoneMin[i];
+        delete[] rel.zoneMax[i];
+    }
+    delete[] rel.zoneMin;
+    delete[] rel.zoneMax;
+    delete[] rel.histograms;
+    for(uint64_t i=0; i<rel.cols; i++)
+        if(rel.index[i] != NULL)
+            deleteColumn(rel.index[i]);
+    delete[] rel.index;
 }
 
 void printData(Relation rel){
@@ -128,10 +198,39 @@ void mapAllData(Relation ** r, uint64_t * relationsSize){
     // Allocate an array of relations according to the number of input files
     *r = new Relation[*relationsSize];
 
-    // Map every file to memory
+    // Map every file to memory, all of them at once
+    TIMEVAR startTime = currentTime();
+    for( uint64_t i = 0; i < *relationsSize; i++ ){
+        myJobScheduler->Schedule(new LoadJob(inputFiles[i], &(*r)[i]));
+    }
+    myJobScheduler->Barrier((int) *relationsSize);
+    for( uint64_t i = 0; i < *relationsSize; i++ ){
+        if((*r)[i].data == NULL){
+            std::cerr << "Error at mapping the relations." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    std::cerr << "Load: " << *relationsSize << " relations ("
+              << ((double)(currentTime() - startTime))/1000000
+              << " seconds)" << '\n';
+
+    // Gather the stats of all the columns of all the relations at once
+    startTime = currentTime();
+    uint8_t *** sketches = new uint8_t**[*relationsSize];
+    uint64_t jobs = 0;
+    for( uint64_t i = 0; i < *relationsSize; i++ ){
+        sketches[i] = new uint8_t*[(*r)[i].cols];
+        jobs += calculateStats(&(*r)[i], sketches[i]);
+    }
+    myJobScheduler->Barrier((int) jobs);
     for( uint64_t i = 0; i < *relationsSize; i++ ){
-        (*r)[i] = mapFile(inputFiles[i]);
+        finishStats(&(*r)[i], sketches[i]);
+        delete[] sketches[i];
     }
+    delete[] sketches;
+    std::cerr << "Stats: " << *relationsSize << " relations ("
+              << ((double)(currentTime() - startTime))/1000000
+              << " seconds)" << '\n';
 
     // Deallocate memory used for file paths
     for(uint64_t i=0; i<*relationsSize; i++){
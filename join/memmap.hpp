@@ -2,10 +2,34 @@
 #include <sys/mman.h>   // for mmap/munmap
 
 #include "inputManager.hpp"
+#include "../singleJoin/structs.hpp"
+#include "../singleJoin/sketch.hpp"
 
 #ifndef MEMMAP_HPP
 #define MEMMAP_HPP
 
+// Rows of a column summarised by one entry of its zone map
+#define ZONE_ROWS 65536
+
+// Zones of a column whose stats are gathered by one job at load time
+#define STATS_CHUNK_ZONES 16
+
+// How the mappings of the relations are filled in at load time, see the
+// --prefault option. PREFAULT_ADVISE only has the kernel read the files
+// ahead in the background, PREFAULT_POPULATE maps every page before mmap
+// returns, so that no query takes the page faults
+#define PREFAULT_OFF 0
+#define PREFAULT_ADVISE 1
+#define PREFAULT_POPULATE 2
+
+extern char prefaultMode;
+
+// Besides the stats of every column, its zone map keeps the minimum and
+// maximum of each block of ZONE_ROWS rows: zoneMin[c][z] and zoneMax[c][z]
+// cover the rows [z * ZONE_ROWS, (z+1) * ZONE_ROWS) of column c, and
+// histograms[c] describes how its values are distributed.
+// index[c] is the secondary index of column c once it is built, see
+// columnIndex, and NULL until then
 typedef struct Relation{
     uint64_t rows;
     uint64_t cols;
@@ -15,11 +39,19 @@ typedef struct Relation{
     double * u;
     double * f;
     double * d;
+
+    uint64_t zones;
+    uint64_t ** zoneMin;
+    uint64_t ** zoneMax;
+    Histogram * histograms;
+
+    Column ** index;
 } Relation;
 
 uint64_t getFileSize(uint64_t rows, uint64_t cols);
-uint64_t * memmap(int fd, uint64_t size);
-void calculateStats(Relation * rel);
+uint64_t * memmap(int fd, uint64_t size, int flags);
+uint64_t calculateStats(Relation * rel, uint8_t ** sketches);
+void finishStats(Relation * rel, uint8_t ** sketches);
 uint64_t ** convertMap(uint64_t * data, uint64_t rows, uint64_t cols);
 Relation mapFile(const char inputFile[]);
 void unmapData(Relation rel);
@@ -156,7 +156,7 @@ void JoinTree::updateLessFilterStatsIR(uint64_t rel, uint64_t col, uint64_t k) {
     }
     else {
         newStats.d = (d*(k-l))/(u-l);
-        newStats.f = (f*(k-l))/(u-l);
+        newStats.f = lessFilterRows(rel, col, l, u, f, k);
     }
 
     updateStats(rel,col,newStats);
@@ -239,7 +239,7 @@ void JoinTree::updateGreaterFilterStatsIR(uint64_t rel, uint64_t col, uint64_t k
     }
     else {
         newStats.d = (d*(u-k))/(u-l);
-        newStats.f = (f*(u-k))/(u-l);
+        newStats.f = greaterFilterRows(rel, col, l, u, f, k);
     }
 
     updateStats(rel,col,newStats);
@@ -322,7 +322,7 @@ void JoinTree::updateLessFilterStats(uint64_t rel, uint64_t col, uint64_t k) {
     }
     else {
         newStats.d = (d*(k-l))/(u-l);
-        newStats.f = (f*(k-l))/(u-l);
+        newStats.f = lessFilterRows(rel, col, l, u, f, k);
     }
 
     updateStats(rel,col,newStats);
@@ -377,7 +377,7 @@ void JoinTree::updateGreaterFilterStats(uint64_t rel, uint64_t col, uint64_t k)
     }
     else {
         newStats.d = (d*(u-k))/(u-l);
-        newStats.f = (f*(u-k))/(u-l);
+        newStats.f = greaterFilterRows(rel, col, l, u, f, k);
     }
 
     updateStats(rel,col,newStats);
@@ -431,7 +431,9 @@ void JoinTree::updateJoinStats(uint64_t relA, uint64_t colA, uint64_t relB, uint
         newStatsA.f = newStatsA.d = newStatsB.f = newStatsB.d = 0;
     }
     else {
-        newStatsA.f = newStatsB.f = (myStats[relA][colA].f*myStats[relB][colB].f)/n;
+        newStatsA.f = newStatsB.f = joinRows(relA, colA, myStats[relA][colA].f,
+                                              relB, colB, myStats[relB][colB].f,
+                                              newL, newU);
         newStatsA.d = newStatsB.d = (myStats[relA][colA].d*myStats[relB][colB].d)/n;
     }
 
@@ -530,7 +532,7 @@ Stats JoinTree::evalLessFilterStats(uint64_t rel, uint64_t col, uint64_t k) {
     }
     else {
         newStats.d = (d*(k-l))/(u-l);
-        newStats.f = (f*(k-l))/(u-l);
+        newStats.f = lessFilterRows(rel, col, l, u, f, k);
     }
 
     return newStats;
@@ -563,7 +565,7 @@ Stats JoinTree::evalGreaterFilterStats(uint64_t rel, uint64_t col, uint64_t k) {
     }
     else {
         newStats.d = (d*(u-k))/(u-l);
-        newStats.f = (f*(u-k))/(u-l);
+        newStats.f = greaterFilterRows(rel, col, l, u, f, k);
     }
 
     return newStats;
@@ -607,7 +609,8 @@ Stats JoinTree::evalJoinStats(uint64_t relA, uint64_t colA, uint64_t relB, uint6
         newStatsA.f = 0;
     }
     else {
-        newStatsA.f = (newStatsA.f*newStatsB.f)/n;
+        newStatsA.f = joinRows(relA, colA, newStatsA.f, relB, colB, newStatsB.f,
+                               newL, newU);
     }
 
     return newStatsA;
@@ -1,8 +1,24 @@
 #include "predicates.hpp"
 #include "../singleJoin/join.hpp"
+#include "../singleJoin/sortMerge.hpp"
+#include "../threads/scheduler.hpp"
+#include "stats.hpp"
+#include "index.hpp"
+#include "../singleJoin/simd.hpp"
+#include <algorithm>
 
 extern Relation * r;
 extern uint64_t relationsSize;
+extern JobScheduler * myJobScheduler;
+
+// Join method given on the command line. Overrides the one of the predicate
+char forcedJoinMethod = AUTO_JOIN;
+
+bool aggregatePushdown = true;
+
+bool packedTuples = true;
+
+bool factorizedJoins = true;
 
 // extern Intermediate IR;
 
@@ -24,9 +40,37 @@ unsigned long long currentTime() {
     return te.tv_sec*1000000 + te.tv_usec;
 }
 
-void execute(Predicate * predicate, uint64_t * queryRelations, Intermediate * IR) {
+// Whether 'predicate' reads the relation a factorized IR keeps in groups
+static bool readsFactor(Predicate * predicate, Intermediate * IR) {
+    if (!isFactorized(IR))
+        return false;
+    if (predicate->relationA == IR->factorRel)
+        return true;
+    return predicate->predicateType == JOIN &&
+           predicate->relationB == IR->factorRel;
+}
+
+// Number of predicates from 'predicates' on that execute runs together: all
+// the filters on the relation of a leading filter, which groupFilters has
+// brought next to each other
+uint64_t filterGroup(Predicate * predicates, uint64_t count) {
+    uint64_t n = 1;
+    if (predicates[0].predicateType != FILTER)
+        return n;
+    while (n < count && predicates[n].predicateType == FILTER &&
+           predicates[n].relationA == predicates[0].relationA)
+        n++;
+    return n;
+}
+
+void execute(Predicate * predicate, uint64_t count, uint64_t * queryRelations,
+             Intermediate * IR) {
+    // The other operators work on the rows of a factorized IR as they are
+    if (readsFactor(predicate, IR))
+        flattenIntermediate(IR);
+
     if (predicate->predicateType == FILTER) {
-        executeFilter(predicate, queryRelations, IR);
+        executeFilters(predicate, count, queryRelations, IR);
     } else if (predicate->predicateType == JOIN) {
         executeJoin(predicate, queryRelations, IR);
     } else {
@@ -34,44 +78,205 @@ void execute(Predicate * predicate, uint64_t * queryRelations, Intermediate * IR
     }
 }
 
-// This function assumes that there is only one filter and it is applied at
-// the start of the query execution only
-void executeFilter(Predicate * predicate, uint64_t * queryRelations, Intermediate * IR) {
-    TIMEVAR startTime = currentTime();
+// What the zone map of a block says about a filter on it
+#define ZONE_NONE 0
+#define ZONE_ALL 1
+#define ZONE_SOME 2
 
-    Relation rel = r[queryRelations[predicate->relationA]];
-    Result * res = newResult();
-    int column = predicate->columnA;
-    uint64_t value = predicate->value;
-    char op = predicate->op;
-
-    // make the list
-    if(op == '<'){
-        for(uint64_t i=0; i<rel.rows; i++)
-            if(rel.data[column][i] < value)
-                insertSingleResult(res, i);
-    }
-    else if(op == '>'){
-        for(uint64_t i=0; i<rel.rows; i++)
-            if(rel.data[column][i] > value)
-                insertSingleResult(res, i);
+static char zoneMatch(uint64_t min, uint64_t max, char op, uint64_t value) {
+    if (op == '<')
+        return min >= value ? ZONE_NONE : max < value ? ZONE_ALL : ZONE_SOME;
+    if (op == '>')
+        return max <= value ? ZONE_NONE : min > value ? ZONE_ALL : ZONE_SOME;
+    if (value < min || value > max)
+        return ZONE_NONE;
+    return min == max ? ZONE_ALL : ZONE_SOME;
+}
+
+// Runs FilterJobs over the rows [0, rows) in morsels of 'morsel' rows and
+// returns the rows that pass, 'total' of them. Morsel m checks the
+// termsCount[m] terms from terms[m] and is skipped when terms[m] is NULL.
+// Every morsel is filtered twice: first every job counts the rows that
+// pass, then it writes them at its offset of the output
+static uint64_t * runFilterJobs(uint64_t rows, uint64_t morsel,
+                                FilterTerm ** terms, uint64_t * termsCount,
+                                uint64_t * rowids, uint64_t * selection,
+                                uint64_t * total) {
+    uint64_t morsels = (rows + morsel - 1) / morsel;
+    uint64_t * offsets = new uint64_t[morsels + 1];
+    uint64_t * out = NULL;
+    *total = 0;
+
+    for (uint64_t m = 0; m < morsels; m++)
+        offsets[m] = 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+        int jobs = 0;
+        for (uint64_t m = 0; m < morsels; m++) {
+            if (terms[m] == NULL) continue;
+            uint64_t start = m * morsel;
+            uint64_t length = start + morsel > rows ? rows - start : morsel;
+            FilterJob * job = new FilterJob(terms[m], termsCount[m], rowids,
+                                            selection, start, length, out,
+                                            &offsets[m]);
+            if (morsels == 1) {
+                job->Run();
+                delete job;
+            }
+            else {
+                myJobScheduler->Schedule(job);
+                jobs++;
+            }
+        }
+        if (jobs > 0)
+            myJobScheduler->Barrier(jobs);
+
+        if (pass == 0) {
+            for (uint64_t m = 0; m < morsels; m++) {
+                uint64_t count = offsets[m];
+                offsets[m] = *total;
+                *total += count;
+            }
+            out = new uint64_t[*total];
+        }
     }
-    else{
-        for(uint64_t i=0; i<rel.rows; i++)
-            if(rel.data[column][i] == value)
-                insertSingleResult(res, i);
+    delete[] offsets;
+    return out;
+}
+
+// Looks the first of the 'count' filters in 'order' up in the secondary
+// index of its column and checks the others on the rowids it finds, which
+// are returned in table order, 'total' of them
+static uint64_t * indexFilter(Relation * rel, uint64_t relIndex,
+                              Predicate ** order, uint64_t count,
+                              uint64_t * total) {
+    Column * index = columnIndex(rel, relIndex, order[0]->columnA);
+    uint64_t first;
+    uint64_t n = indexLookup(index, order[0]->op, order[0]->value, &first);
+
+    uint64_t * rowids = new uint64_t[n];
+    memcpy(rowids, index->rowid + first, n * sizeof(uint64_t));
+    // The rowids of one value are in order already, those of a range are not
+    if (order[0]->op != '=')
+        std::sort(rowids, rowids + n);
+
+    for (uint64_t i = 1; i < count; i++)
+        n = refinePositions(rel->data[order[i]->columnA], NULL, rowids, n,
+                            order[i]->value, order[i]->op);
+    *total = n;
+    return rowids;
+}
+
+// Applies the 'count' filters 'predicates', which are all on the same
+// relation, in one pass with the most selective first.
+// A relation that is not in the IR yet is scanned in its zones: zones that
+// the zone map rules out for a filter are skipped, and the filters that
+// the zone map accepts whole are not checked in it. When the most
+// selective filter is expected to keep only a few rows, they are looked up
+// in the secondary index of its column instead. A relation that is
+// already joined has its live IR rows filtered instead, and only those
+// rows are kept
+void executeFilters(Predicate * predicates, uint64_t count,
+                    uint64_t * queryRelations, Intermediate * IR) {
+    TIMEVAR startTime = currentTime();
+
+    uint64_t relation = predicates[0].relationA;
+    uint64_t relIndex = queryRelations[relation];
+    Relation rel = r[relIndex];
+
+    // Insertion sort by estimated selectivity, there are only a few filters
+    Predicate ** order = new Predicate*[count];
+    double * selectivity = new double[count];
+    for (uint64_t i = 0; i < count; i++) {
+        Predicate * predicate = &predicates[i];
+        double s = filterSelectivity(relIndex, predicate->columnA,
+                                     predicate->op, predicate->value);
+        uint64_t j = i;
+        for (; j > 0 && selectivity[j - 1] > s; j--) {
+            order[j] = order[j - 1];
+            selectivity[j] = selectivity[j - 1];
+        }
+        order[j] = predicate;
+        selectivity[j] = s;
     }
 
-    // Load results into Intermediate Results
-    IR->results[predicate->relationA] = fastResultToArray(res);
-    IR->length = res->totalEntries;
+    bool joined = isInIntermediate(IR, relation);
+    bool indexed = !joined && secondaryIndexes != INDEX_OFF &&
+                   selectivity[0] < INDEX_SELECTIVITY;
+    delete[] selectivity;
+
+    uint64_t morsels = indexed ? 0
+                     : joined ? (IR->length + IR_MORSEL - 1) / IR_MORSEL
+                     : rel.zones;
+    FilterTerm * terms = new FilterTerm[(morsels + 1) * count];
+    FilterTerm ** morselTerms = new FilterTerm*[morsels + 1];
+    uint64_t * termsCount = new uint64_t[morsels + 1];
+    uint64_t skipped = 0;
+
+    for (uint64_t m = 0; m < morsels; m++) {
+        morselTerms[m] = &terms[m * count];
+        termsCount[m] = 0;
+        for (uint64_t i = 0; i < count; i++) {
+            Predicate * predicate = order[i];
+            uint64_t column = predicate->columnA;
+            char match = ZONE_SOME;
+            if (!joined)
+                match = zoneMatch(rel.zoneMin[column][m],
+                                  rel.zoneMax[column][m],
+                                  predicate->op, predicate->value);
+            if (match == ZONE_NONE) {
+                morselTerms[m] = NULL;
+                skipped++;
+                break;
+            }
+            if (match == ZONE_ALL)
+                continue;
+            FilterTerm * term = &morselTerms[m][termsCount[m]++];
+            term->values = rel.data[column];
+            term->value = predicate->value;
+            term->op = predicate->op;
+        }
+    }
 
-    deleteResult(res);
+    uint64_t total;
+    if (indexed) {
+        uint64_t * rowids = indexFilter(&r[relIndex], relIndex, order, count,
+                                        &total);
+        setIntermediateColumn(IR, relation, rowids);
+        IR->length = total;
+    }
+    else if (joined) {
+        uint64_t * rows = runFilterJobs(IR->length, IR_MORSEL, morselTerms,
+                                        termsCount, IR->results[relation],
+                                        IR->selection, &total);
+        selectIntermediate(IR, rows, total);
+    }
+    else {
+        // Load results into Intermediate Results
+        uint64_t * rowids = runFilterJobs(rel.rows, ZONE_ROWS, morselTerms,
+                                          termsCount, NULL, NULL, &total);
+        setIntermediateColumn(IR, relation, rowids);
+        IR->length = total;
+    }
 
-    std::cerr << "Filter: " << predicate->relationA << "." << column << " "
-              << op << " " << value
-    << " (" << ((double)(currentTime() - startTime))/1000000
-    << " seconds, " << IR->length << " entries)" << '\n';
+    std::cerr << (joined ? "Secondary Filter: " : "Filter: ");
+    for (uint64_t i = 0; i < count; i++) {
+        if (i > 0) std::cerr << " & ";
+        std::cerr << relation << "." << order[i]->columnA << " "
+                  << order[i]->op << " " << order[i]->value;
+    }
+    std::cerr << " (" << ((double)(currentTime() - startTime))/1000000
+    << " seconds, " << IR->length << " entries";
+    if (indexed)
+        std::cerr << ", index";
+    else if (!joined)
+        std::cerr << ", " << skipped << "/" << rel.zones << " zones skipped";
+    std::cerr << ")" << '\n';
+
+    delete[] order;
+    delete[] terms;
+    delete[] morselTerms;
+    delete[] termsCount;
 }
 
 void executeJoin(Predicate * predicate, uint64_t * queryRelations, Intermediate * IR) {
@@ -126,16 +331,17 @@ void executeJoin(Predicate * predicate, uint64_t * queryRelations, Intermediate
     // // If one of the two relations is not in the intermediate results
     Column * fromIntermediate;
     Column * fromMappedData;
+    uint64_t colNotInIR;
 
     if(isInIntermediate(IR, relA) && !isInIntermediate(IR, relB)) {
         fromIntermediate = construct(IR,relA,colA,queryRelations);
-        fromMappedData = constructMappedData(relB,colB,queryRelations);
         relNotInIR = relB;
+        colNotInIR = colB;
     }
     else if(!isInIntermediate(IR, relA) && isInIntermediate(IR, relB)) {
-        fromMappedData = constructMappedData(relA,colA,queryRelations);
         fromIntermediate = construct(IR,relB,colB,queryRelations);
         relNotInIR = relA;
+        colNotInIR = colA;
     }
     else {
         std::cerr << "Error in executeJoin(). No relation is present in the "
@@ -144,6 +350,22 @@ void executeJoin(Predicate * predicate, uint64_t * queryRelations, Intermediate
         exit(0);
     }
 
+    // When the intermediate side is much smaller, only the tuples of the
+    // mapped side that may find a match go on to the join
+    uint64_t mappedRows = r[queryRelations[relNotInIR]].rows;
+    bool bloom = fromIntermediate->size * BLOOM_SIZE_RATIO <= mappedRows;
+
+    if(bloom){
+        BloomFilter * filter = buildBloomFilter(fromIntermediate);
+        fromMappedData = constructBloomMappedData(relNotInIR, colNotInIR,
+                                                  queryRelations, filter);
+        deleteBloomFilter(filter);
+    }
+    else{
+        fromMappedData = constructMappedData(relNotInIR, colNotInIR,
+                                             queryRelations);
+    }
+
 
     std::cerr << "Constructs: "
     << " (" << ((double)(currentTime() - startTime))/1000000
@@ -152,71 +374,360 @@ void executeJoin(Predicate * predicate, uint64_t * queryRelations, Intermediate
 
     startTime = currentTime();
 
-    Result ** res = join(fromIntermediate, fromMappedData);
+    char method = selectJoinMethod(predicate, queryRelations, fromIntermediate, fromMappedData);
+    JoinResult * res = executeJoinMethod(method, predicate, queryRelations,
+                                         fromIntermediate, fromMappedData);
 
     std::cerr << "Join: " << relA << "." << colA << " = "
                          << relB << "." << colB
     << " (" << ((double)(currentTime() - startTime))/1000000
-    << " seconds, " << IR->length << " entries)" << '\n';
+    << " seconds, " << res->size << " entries, ";
+    printJoinMethod(method);
+    if(bloom)
+        std::cerr << ", bloom pruned " << mappedRows - fromMappedData->size
+                  << "/" << mappedRows;
+    std::cerr << ")" << '\n';
 
     deleteColumn(fromIntermediate);
-    delete[] fromMappedData->rowid;
-    delete fromMappedData;
+    if(bloom){
+        deleteColumn(fromMappedData);
+    }
+    else{
+        delete[] fromMappedData->rowid;
+        delete fromMappedData;
+    }
 
     // std::cerr << "Join done. Results are:" << std::endl;
     // printDoubleResult(res);
 
 
     startTime = currentTime();
-    joinUpdateIR(res, relNotInIR, IR);
+    joinUpdateIR(res, relNotInIR, IR, predicate->factorize);
 
     std::cerr << "Total Update IR: "
     << " (" << ((double)(currentTime() - startTime))/1000000
     << " seconds)" << '\n';
+}
+
+// Range of keys that can appear on both sides of a join, from the stats of
+// the two columns. Filters and earlier joins only shrink it. When it is
+// empty, high is below low
+void joinDomain(Predicate * predicate, uint64_t * queryRelations,
+                uint64_t * low, uint64_t * high){
+    Relation * relA = &r[queryRelations[predicate->relationA]];
+    Relation * relB = &r[queryRelations[predicate->relationB]];
+    uint64_t colA = predicate->columnA;
+    uint64_t colB = predicate->columnB;
+
+    uint64_t lowA = (uint64_t) relA->l[colA];
+    uint64_t lowB = (uint64_t) relB->l[colB];
+    uint64_t highA = (uint64_t) relA->u[colA];
+    uint64_t highB = (uint64_t) relB->u[colB];
+
+    *low = lowA > lowB ? lowA : lowB;
+    *high = highA < highB ? highA : highB;
+}
+
+// Decide how each join predicate is run, once its two columns are built. A
+// method forced on the command line comes first. Otherwise a dense key
+// domain is joined through a direct array, a small side skips partitioning
+// altogether, a sort-merge join is used only when both inputs already look
+// sorted, so the sort is almost free, and the radix hash join in every other
+// case
+char selectJoinMethod(Predicate * predicate, uint64_t * queryRelations,
+                      Column * A, Column * B){
+    uint64_t smaller = A->size < B->size ? A->size : B->size;
+    uint64_t low, high;
+    joinDomain(predicate, queryRelations, &low, &high);
+
+    // The stats are doubles, so huge keys may have been rounded
+    bool directFits = high < ((uint64_t) 1 << 53) &&
+                      directJoinFits(low, high, smaller);
+
+    char method = forcedJoinMethod;
+    if(method == DIRECT_JOIN && !directFits)
+        method = AUTO_JOIN;
+    if(method != AUTO_JOIN)
+        return method;
+
+    if(directFits && (high < low ||
+                      high - low < DIRECT_JOIN_DENSITY * smaller))
+        return DIRECT_JOIN;
+
+    if(smaller <= sharedJoinThreshold)
+        return SHARED_HASH_JOIN;
+
+    if(sortedFraction(A) >= SORT_MERGE_SORTEDNESS &&
+       sortedFraction(B) >= SORT_MERGE_SORTEDNESS)
+        return SORT_MERGE_JOIN;
+    return RADIX_JOIN;
+}
+
+// Rowids of A are always returned in rowidA and those of B in rowidB
+JoinResult * executeJoinMethod(char method, Predicate * predicate,
+                               uint64_t * queryRelations, Column * A, Column * B){
+    if(method == DIRECT_JOIN){
+        uint64_t low, high;
+        joinDomain(predicate, queryRelations, &low, &high);
+        return directJoin(A, B, low, high);
+    }
+    if(method == SORT_MERGE_JOIN)
+        return sortMergeJoin(A, B);
+    if(method == SHARED_HASH_JOIN)
+        return sharedJoin(A, B);
+    return join(A, B, packedJoinFits(predicate, queryRelations, A, B));
+}
 
-    deleteResult(res[0]);
-    deleteResult(res[1]);
-    delete[] res;
+// A radix join can pack its tuples when the stats bound the keys of both
+// columns below 2^32 and no rowid reaches it. The rowids of a side are IR
+// rows or rows of its relation, so both counts are checked
+bool packedJoinFits(Predicate * predicate, uint64_t * queryRelations,
+                    Column * A, Column * B){
+    Relation * relA = &r[queryRelations[predicate->relationA]];
+    Relation * relB = &r[queryRelations[predicate->relationB]];
+
+    return packedTuples &&
+           relA->u[predicate->columnA] < (double) PACKED_LIMIT &&
+           relB->u[predicate->columnB] < (double) PACKED_LIMIT &&
+           relA->rows < PACKED_LIMIT && relB->rows < PACKED_LIMIT &&
+           A->size < PACKED_LIMIT && B->size < PACKED_LIMIT;
 }
 
-// In the results, the 'left' column will always be from the IR
-void joinUpdateIR(Result ** res, uint64_t newRel, Intermediate * IR){
-    uint64_t newLength = res[0]->totalEntries;
+void printJoinMethod(char method){
+    if(method == SORT_MERGE_JOIN){
+        std::cerr << "sort-merge";
+    }
+    else if(method == SHARED_HASH_JOIN){
+        std::cerr << "shared hash";
+    }
+    else if(method == DIRECT_JOIN){
+        std::cerr << "direct";
+    }
+    else{
+        std::cerr << "radix, ";
+        printRadixPlan(radixPlan);
+    }
+}
 
+// Executes the last join of a query and returns its sums, without building
+// the pairs of the join or updating the IR. Side A of the join is always
+// the IR, or relation A when the IR is empty
+uint64_t * executeJoinAggregate(Predicate * predicate, QueryInfo * queryInfo,
+                                Intermediate * IR){
     TIMEVAR startTime = currentTime();
-    // Convert the results of the most recent join into an array
-    uint64_t * fromIntermediate = fastResultToArray(res[0]);
-    std::cerr << "Conversion from IR to array"
-    << " (" << ((double)(currentTime() - startTime))/1000000
-    << " seconds, " << newLength << " entries)" << '\n';
 
-    startTime = currentTime();
-    uint64_t * fromMappedData = fastResultToArray(res[1]);
-    std::cerr << "Conversion from mapped data to array"
+    uint64_t * queryRelations = queryInfo->relations;
+    uint64_t relA = predicate->relationA;
+    uint64_t colA = predicate->columnA;
+    uint64_t relB = predicate->relationB;
+    uint64_t colB = predicate->columnB;
+    uint64_t sumsCount = queryInfo->sumsCount;
+
+    uint64_t * sums = new uint64_t[sumsCount];
+    for(uint64_t j=0; j<sumsCount; j++)
+        sums[j] = 0;
+
+    if(readsFactor(predicate, IR))
+        flattenIntermediate(IR);
+
+    uint64_t ** values = new uint64_t*[sumsCount];
+    uint64_t ** prefix = new uint64_t*[sumsCount];
+    for(uint64_t j=0; j<sumsCount; j++){
+        uint64_t relation = queryInfo->sums[j].relation;
+        values[j] = r[queryRelations[relation]].data[queryInfo->sums[j].column];
+        prefix[j] = NULL;
+        if(isFactorized(IR) && relation == IR->factorRel)
+            prefix[j] = factorPrefixSums(IR, values[j]);
+    }
+
+    // Both relations are already joined, so this is a filter on the IR
+    if(!isEmpty(IR) && isInIntermediate(IR, relA) && isInIntermediate(IR, relB)){
+        Column * constructedA = construct(IR, relA, colA, queryRelations);
+        Column * constructedB = construct(IR, relB, colB, queryRelations);
+        uint64_t matches = 0;
+
+        for(uint64_t i = 0; i < constructedA->size; i++){
+            if(constructedA->value[i] != constructedB->value[i]) continue;
+            matches++;
+            for(uint64_t j=0; j<sumsCount; j++)
+                sums[j] += intermediateRowSum(IR, queryInfo->sums[j].relation,
+                                              values[j], prefix[j], i);
+        }
+
+        deleteColumn(constructedA);
+        deleteColumn(constructedB);
+        for(uint64_t j=0; j<sumsCount; j++)
+            delete[] prefix[j];
+        delete[] prefix;
+        delete[] values;
+
+        std::cerr << "Secondary Self Join Aggregate: " << relA << "." << colA
+                  << " = " << relB << "." << colB
+        << " (" << ((double)(currentTime() - startTime))/1000000
+        << " seconds, " << matches << " matches)" << '\n';
+
+        return sums;
+    }
+
+    Column * fromIntermediate;
+    Column * fromMappedData;
+    uint64_t relNotInIR;
+    uint64_t colNotInIR;
+    bool bloom = false;
+
+    // The sums below index the IR columns with the rows of the join
+    compactIntermediate(IR);
+
+    if(isEmpty(IR)){
+        fromIntermediate = constructMappedData(relA, colA, queryRelations);
+        relNotInIR = relB;
+        colNotInIR = colB;
+    }
+    else if(isInIntermediate(IR, relA)){
+        fromIntermediate = construct(IR, relA, colA, queryRelations);
+        relNotInIR = relB;
+        colNotInIR = colB;
+    }
+    else if(isInIntermediate(IR, relB)){
+        fromIntermediate = construct(IR, relB, colB, queryRelations);
+        relNotInIR = relA;
+        colNotInIR = colA;
+    }
+    else{
+        std::cerr << "Error in executeJoinAggregate(). No relation is present "
+                  << "in the intermediate results. This type of operation is "
+                  << "not yet supported. This program will exit..." << std::endl;
+        exit(0);
+    }
+
+    // Same pruning as executeJoin
+    uint64_t mappedRows = r[queryRelations[relNotInIR]].rows;
+    if(!isEmpty(IR) && fromIntermediate->size * BLOOM_SIZE_RATIO <= mappedRows){
+        BloomFilter * filter = buildBloomFilter(fromIntermediate);
+        fromMappedData = constructBloomMappedData(relNotInIR, colNotInIR,
+                                                  queryRelations, filter);
+        deleteBloomFilter(filter);
+        bloom = true;
+    }
+    else{
+        fromMappedData = constructMappedData(relNotInIR, colNotInIR,
+                                             queryRelations);
+    }
+
+    // Rowids of the IR side are IR rows, those of the mapped side are
+    // already rows of their relation. The IR sums of a factorized IR are
+    // summed over every group first, and its rows weigh as much as their
+    // groups in the sums of the other side
+    AggregateSum * requested = new AggregateSum[sumsCount];
+    uint64_t ** grouped = new uint64_t*[sumsCount];
+    for(uint64_t j=0; j<sumsCount; j++){
+        uint64_t relation = queryInfo->sums[j].relation;
+        requested[j].values = values[j];
+        grouped[j] = NULL;
+        if(relation == relNotInIR){
+            requested[j].side = 1;
+            requested[j].rowids = NULL;
+        }
+        else if(isFactorized(IR)){
+            grouped[j] = new uint64_t[IR->length];
+            for(uint64_t i=0; i<IR->length; i++)
+                grouped[j][i] = intermediateRowSum(IR, relation, values[j],
+                                                   prefix[j], i);
+            requested[j].side = 0;
+            requested[j].values = grouped[j];
+            requested[j].rowids = NULL;
+        }
+        else{
+            requested[j].side = 0;
+            requested[j].rowids = isEmpty(IR) ? NULL : IR->results[relation];
+        }
+    }
+
+    bool packed = packedJoinFits(predicate, queryRelations,
+                                 fromIntermediate, fromMappedData);
+    uint64_t * joined = joinAggregate(fromIntermediate, fromMappedData,
+                                      requested, sumsCount,
+                                      isFactorized(IR) ? IR->factorCount : NULL,
+                                      packed);
+    for(uint64_t j=0; j<sumsCount; j++){
+        sums[j] = joined[j];
+        delete[] grouped[j];
+        delete[] prefix[j];
+    }
+    delete[] joined;
+    delete[] requested;
+    delete[] grouped;
+    delete[] prefix;
+    delete[] values;
+
+    std::cerr << "Join Aggregate: " << relA << "." << colA << " = "
+                                    << relB << "." << colB
     << " (" << ((double)(currentTime() - startTime))/1000000
-    << " seconds, " << newLength << " entries)" << '\n';
+    << " seconds, radix, ";
+    printRadixPlan(radixPlan);
+    if(packed)
+        std::cerr << ", packed";
+    if(isFactorized(IR))
+        std::cerr << ", factorized";
+    if(bloom)
+        std::cerr << ", bloom pruned " << mappedRows - fromMappedData->size
+                  << "/" << mappedRows;
+    std::cerr << ")" << '\n';
+
+    if(isEmpty(IR)){
+        delete[] fromIntermediate->rowid;
+        delete fromIntermediate;
+    }
+    else{
+        deleteColumn(fromIntermediate);
+    }
+    if(bloom){
+        deleteColumn(fromMappedData);
+    }
+    else{
+        delete[] fromMappedData->rowid;
+        delete fromMappedData;
+    }
+
+    return sums;
+}
+
+// In the results, the 'left' column will always be from the IR. The join
+// output is consumed: its right column becomes the IR column of 'newRel',
+// or its groups when the join may be factorized and fans out
+void joinUpdateIR(JoinResult * res, uint64_t newRel, Intermediate * IR,
+                  bool factorize){
+    uint64_t newLength = res->size;
+    uint64_t * fromIntermediate = res->rowidA;
+
+    if(factorize && !isFactorized(IR) &&
+       newLength >= FACTORIZE_FANOUT * IR->length){
+        TIMEVAR startTime = currentTime();
+        factorizeIntermediate(IR, newRel, fromIntermediate, res->rowidB,
+                              newLength);
+        delete res;
+
+        std::cerr << "IR factorization: "
+        << " (" << ((double)(currentTime() - startTime))/1000000
+        << " seconds, " << IR->length << " groups, " << newLength
+        << " entries)" << '\n';
+        return;
+    }
 
     // Run through the exising results in the IR and
     // update them based on the latest join results
 
-    startTime = currentTime();
-    for(uint64_t i=0; i<4; i++){
-        if(IR->results[i] == NULL) continue;
-        uint64_t * temp = IR->results[i];
-        IR->results[i] = new uint64_t[newLength];
-        for(uint64_t j=0; j<newLength; j++){
-            IR->results[i][j] = temp[fromIntermediate[j]];
-        }
-        delete[] temp;
-    }
+    TIMEVAR startTime = currentTime();
+    gatherIntermediate(IR, fromIntermediate, newLength);
     delete[] fromIntermediate;
 
     std::cerr << "IR replacement: "
     << " (" << ((double)(currentTime() - startTime))/1000000
     << " seconds, " << newLength << " entries)" << '\n';
 
-    IR->results[newRel] = fromMappedData;
+    setIntermediateColumn(IR, newRel, res->rowidB);
     IR->length = newLength;
+    delete res;
 }
 
 void executeNoFilterJoin(Predicate * predicate, uint64_t * queryRelations, Intermediate * IR) {
@@ -242,12 +753,16 @@ void executeNoFilterJoin(Predicate * predicate, uint64_t * queryRelations, Inter
 
     startTime = currentTime();
 
-    Result ** res = join(constructedA, constructedB);
+    char method = selectJoinMethod(predicate, queryRelations, constructedA, constructedB);
+    JoinResult * res = executeJoinMethod(method, predicate, queryRelations,
+                                         constructedA, constructedB);
 
     std::cerr << "No Filter Join: " << relA << "." << colA << " = "
                          << relB << "." << colB
     << " (" << ((double)(currentTime() - startTime))/1000000
-    << " seconds, " << res[0]->totalEntries << " entries)" << '\n';
+    << " seconds, " << res->size << " entries, ";
+    printJoinMethod(method);
+    std::cerr << ")" << '\n';
 
     delete[] constructedA->rowid;
     delete constructedA;
@@ -260,18 +775,15 @@ void executeNoFilterJoin(Predicate * predicate, uint64_t * queryRelations, Inter
 
     startTime = currentTime();
 
-    // Update intermediate results
-    IR->length = res[0]->totalEntries;
-    IR->results[relA] = fastResultToArray(res[0]);
-    IR->results[relB] = fastResultToArray(res[1]);
+    // Update intermediate results. The IR takes over the join output
+    IR->length = res->size;
+    setIntermediateColumn(IR, relA, res->rowidA);
+    setIntermediateColumn(IR, relB, res->rowidB);
+    delete res;
 
     std::cerr << "Total Update IR: "
     << " (" << ((double)(currentTime() - startTime))/1000000
     << " seconds)" << '\n';
-
-    deleteResult(res[0]);
-    deleteResult(res[1]);
-    delete[] res;
 }
 
 void executeSelfjoin(Predicate * predicate, uint64_t * queryRelations, Intermediate * IR) {
@@ -320,20 +832,9 @@ void selfJoinUpdateIR(Result * selfJoinResults, Intermediate * IR){
     // Convert the results of the most recent self join into an array
     uint64_t * rowIDs = fastResultToArray(selfJoinResults);
 
-    // Run through the exising results in the IR and
-    // update them based on the latest self join results
-    for(uint64_t i=0; i<4; i++){
-        if(IR->results[i] == NULL) continue;
-        uint64_t * temp = IR->results[i];
-        IR->results[i] = new uint64_t[newLength];
-        for(uint64_t j=0; j<newLength; j++){
-            IR->results[i][j] = temp[rowIDs[j]];
-        }
-        delete[] temp;
-    }
-    delete[] rowIDs;
-
-    IR->length = newLength;
+    // Only the rows that passed are recorded. The columns are rewritten
+    // later, by the next join or once few enough rows are left
+    selectIntermediate(IR, rowIDs, newLength);
 }
 
 void executeNoFilterSelfjoin(Predicate * predicate, uint64_t * queryRelations, Intermediate * IR){
@@ -363,7 +864,7 @@ void executeNoFilterSelfjoin(Predicate * predicate, uint64_t * queryRelations, I
     // Update intermediate results
     uint64_t * resultsArray = fastResultToArray(res);
     IR->length = res->totalEntries;
-    IR->results[rel] = resultsArray;
+    setIntermediateColumn(IR, rel, resultsArray);
 
     std::cerr << "No Filter Self Join: " << rel << "." << columnA << " = "
                                << rel << "." << columnB
@@ -373,35 +874,44 @@ void executeNoFilterSelfjoin(Predicate * predicate, uint64_t * queryRelations, I
     deleteResult(res);
 }
 
+// A factorized IR is summed without flattening it, see intermediateRowSum
 void calculateSums(QueryInfo * qi, Intermediate *IR){
-    uint64_t sum = 0;
+    uint64_t * sums = new uint64_t[qi->sumsCount];
 
     for(uint64_t j=0; j<qi->sumsCount; j++){
         TIMEVAR startTime = currentTime();
 
         uint64_t relation = qi->sums[j].relation;
         uint64_t relColumn = qi->sums[j].column;
-
-        for(uint64_t i=0; i<IR->length; i++){
-            uint64_t relIndex = qi->relations[relation];
-            uint64_t relRowID = IR->results[relation][i];
-            sum += r[relIndex].data[relColumn][relRowID];
+        uint64_t * values = r[qi->relations[relation]].data[relColumn];
+        uint64_t sum = 0;
+
+        if(isFactorized(IR) && relation == IR->factorRel){
+            uint64_t * prefix = factorPrefixSums(IR, values);
+            for(uint64_t i=0; i<IR->length; i++)
+                sum += intermediateRowSum(IR, relation, values, prefix, i);
+            delete[] prefix;
+        }
+        else if(!isEmpty(IR)){
+            sum = sumIntermediateValues(IR, relation, values);
         }
+        sums[j] = sum;
 
         std::cerr << "Sum " << qi->sums[j].relation << "."
         << qi->sums[j].column << ": " << sum
     << " (" << ((double)(currentTime() - startTime))/1000000
     << " seconds, " << IR->length << " entries)" << '\n';
-
-    if(j == 0){
-        writeSum(sum);
-    }
-    else{
-        writeWhitespace();
-        writeSum(sum);
     }
 
-        sum = 0;
+    writeSums(qi, sums);
+    delete[] sums;
+}
+
+void writeSums(QueryInfo * qi, uint64_t * sums){
+    for(uint64_t j=0; j<qi->sumsCount; j++){
+        if(j != 0)
+            writeWhitespace();
+        writeSum(sums[j]);
     }
 
     writeNewLine();
@@ -421,6 +931,68 @@ void makeJoin(QueryInfo * q, int relationA, int columnA, int relationB, int colu
     q->predicates[index].relationB = (uint64_t) relationB;
     q->predicates[index].columnB = (uint64_t) columnB;
     q->predicates[index].predicateType = JOIN;
+    q->predicates[index].factorize = false;
+}
+
+// Moves every filter up next to the first filter on the same relation, so
+// that execute applies all the filters on a relation together. Filters
+// only move forward, and the other predicates keep their order
+void groupFilters(QueryInfo * q) {
+    Predicate * predicates = q->predicates;
+    uint64_t count = q->predicatesCount;
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (predicates[i].predicateType != FILTER)
+            continue;
+        uint64_t next = i + 1;
+        for (uint64_t j = i + 1; j < count; j++) {
+            if (predicates[j].predicateType != FILTER ||
+                predicates[j].relationA != predicates[i].relationA)
+                continue;
+            Predicate moved = predicates[j];
+            for (uint64_t k = j; k > next; k--)
+                predicates[k] = predicates[k - 1];
+            predicates[next++] = moved;
+        }
+        i = next - 1;
+    }
+}
+
+// Marks the joins that may leave their matches grouped in the IR: those
+// that add a relation which no later predicate reads, so the IR would only
+// have to be flattened for nothing. Follows which relations are in the IR
+// the same way the execution does
+void planFactorization(QueryInfo * q) {
+    bool * joined = new bool[q->relationsCount];
+    for (uint64_t i = 0; i < q->relationsCount; i++)
+        joined[i] = false;
+
+    for (uint64_t p = 0; p < q->predicatesCount; p++) {
+        Predicate * predicate = &q->predicates[p];
+        uint64_t relA = predicate->relationA;
+        if (predicate->predicateType != JOIN) {
+            joined[relA] = true;
+            continue;
+        }
+
+        uint64_t relB = predicate->relationB;
+        predicate->factorize = false;
+        if (factorizedJoins && joined[relA] != joined[relB]) {
+            uint64_t newRel = joined[relA] ? relB : relA;
+            bool readLater = false;
+            for (uint64_t l = p + 1; l < q->predicatesCount; l++) {
+                Predicate * later = &q->predicates[l];
+                if (later->relationA == newRel ||
+                    (later->predicateType == JOIN && later->relationB == newRel))
+                    readLater = true;
+            }
+            predicate->factorize = !readLater;
+        }
+        joined[relA] = true;
+        joined[relB] = true;
+    }
+
+    delete[] joined;
 }
 
 void makeSelfJoin(QueryInfo * q, int relation, int columnA, int columnB, int index) {
@@ -19,6 +19,17 @@
 
 #define TIMEVAR unsigned long long
 
+// Join methods. AUTO_JOIN leaves the choice to selectJoinMethod
+#define AUTO_JOIN 0
+#define RADIX_JOIN 1
+#define SORT_MERGE_JOIN 2
+#define SHARED_HASH_JOIN 3
+#define DIRECT_JOIN 4
+
+// Fraction of sampled adjacent pairs that must be in order in both inputs
+// for the automatic choice to prefer a sort-merge join
+#define SORT_MERGE_SORTEDNESS 0.99
+
 typedef struct Predicate {
     uint64_t relationA;
     uint64_t columnA;
@@ -27,6 +38,7 @@ typedef struct Predicate {
     char op;
     uint64_t value;
     char predicateType;
+    bool factorize;
 } Predicate;
 
 typedef struct SumStruct {
@@ -44,16 +56,42 @@ typedef struct QueryInfo {
 } QueryInfo;
 
 bool compare(uint64_t x, uint64_t y, char op);
+TIMEVAR currentTime();
 
-void execute(Predicate * p, uint64_t * relations, Intermediate * IR);
+// Filters on the same relation run together as one conjunctive filter, see
+// groupFilters
+void groupFilters(QueryInfo * q);
+uint64_t filterGroup(Predicate * predicates, uint64_t count);
+void execute(Predicate * p, uint64_t count, uint64_t * relations,
+             Intermediate * IR);
 
-void executeFilter(Predicate * predicate, uint64_t * relations, Intermediate * IR);
+void executeFilters(Predicate * predicates, uint64_t count,
+                    uint64_t * relations, Intermediate * IR);
 void executeJoin(Predicate * predicate, uint64_t * relations, Intermediate * IR);
 void executeSelfjoin(Predicate * predicate, uint64_t * relations, Intermediate * IR);
 void executeNoFilterSelfjoin(Predicate * predicate, uint64_t * relations, Intermediate * IR);
 void executeNoFilterJoin(Predicate * predicate, uint64_t * queryRelations, Intermediate * IR);
 
-void joinUpdateIR(Result ** res, uint64_t newRel, Intermediate * IR);
+void joinDomain(Predicate * predicate, uint64_t * queryRelations,
+                uint64_t * low, uint64_t * high);
+char selectJoinMethod(Predicate * predicate, uint64_t * queryRelations,
+                      Column * A, Column * B);
+JoinResult * executeJoinMethod(char method, Predicate * predicate,
+                               uint64_t * queryRelations, Column * A, Column * B);
+
+// Whether radix joins may partition packed 32-bit keys and rowids
+extern bool packedTuples;
+bool packedJoinFits(Predicate * predicate, uint64_t * queryRelations,
+                    Column * A, Column * B);
+void printJoinMethod(char method);
+
+// Whether a query that ends with a join computes its sums inside that join
+extern bool aggregatePushdown;
+uint64_t * executeJoinAggregate(Predicate * predicate, QueryInfo * queryInfo,
+                                Intermediate * IR);
+
+void joinUpdateIR(JoinResult * res, uint64_t newRel, Intermediate * IR,
+                  bool factorize);
 void selfJoinUpdateIR(Result * selfJoinResults, Intermediate * IR);
 
 void makeFilter(QueryInfo * q, int relation, int column, char op, int rv,
@@ -63,12 +101,18 @@ void makeJoin(QueryInfo * q, int relationA, int columnA, int relationB,
 void makeSelfJoin(QueryInfo * q, int relation, int columnA, int columnB,
                 int index);
 
+// Whether joins may keep their matches grouped per IR row, see
+// planFactorization
+extern bool factorizedJoins;
+void planFactorization(QueryInfo * q);
+
 void printPredicate(Predicate * predicate);
 void printFilter(Predicate * predicate);
 void printJoin(Predicate * predicate);
 void printSelfjoin(Predicate * predicate);
 
 void calculateSums(QueryInfo * queryInfo, Intermediate * IR);
+void writeSums(QueryInfo * queryInfo, uint64_t * sums);
 
 void copyPredicates(Predicate ** target, Predicate * source, uint64_t count);
 
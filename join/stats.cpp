@@ -67,7 +67,7 @@ void updateEqualFilterStats(uint64_t rel, uint64_t col, uint64_t k){
     }
     else{
         // If k is in the range [l,u] and there is atleast one distinct value
-        newStats.f = f/d;
+        newStats.f = equalFilterRows(rel, col, l, u, f, d, k);
         newStats.d = 1;
     }
 
@@ -124,7 +124,7 @@ void updateLessFilterStats(uint64_t rel, uint64_t col, uint64_t k) {
     }
     else {
         newStats.d = (d*(k-l))/(u-l);
-        newStats.f = (f*(k-l))/(u-l);
+        newStats.f = lessFilterRows(rel, col, l, u, f, k);
     }
 
     updateStats(rel,col,newStats);
@@ -179,7 +179,7 @@ void updateGreaterFilterStats(uint64_t rel, uint64_t col, uint64_t k) {
     }
     else {
         newStats.d = (d*(u-k))/(u-l);
-        newStats.f = (f*(u-k))/(u-l);
+        newStats.f = greaterFilterRows(rel, col, l, u, f, k);
     }
 
     updateStats(rel,col,newStats);
@@ -291,7 +291,9 @@ void updateJoinStats(uint64_t relA, uint64_t colA, uint64_t relB, uint64_t colB)
         newStatsA.f = newStatsA.d = newStatsB.f = newStatsB.d = 0;
     }
     else {
-        newStatsA.f = newStatsB.f = (stats[relA][colA].f*stats[relB][colB].f)/n;
+        newStatsA.f = newStatsB.f = joinRows(relA, colA, stats[relA][colA].f,
+                                              relB, colB, stats[relB][colB].f,
+                                              newL, newU);
         newStatsA.d = newStatsB.d = (stats[relA][colA].d*stats[relB][colB].d)/n;
     }
 
@@ -362,7 +364,7 @@ Stats evalEqualFilterStats(uint64_t rel, uint64_t col, uint64_t k){
     }
     else{
         // If k is in the range [l,u] and there is atleast one distinct value
-        newStats.f = f/d;
+        newStats.f = equalFilterRows(rel, col, l, u, f, d, k);
         newStats.d = 1;
     }
 
@@ -397,7 +399,7 @@ Stats evalLessFilterStats(uint64_t rel, uint64_t col, uint64_t k) {
     }
     else {
         newStats.d = (d*(k-l))/(u-l);
-        newStats.f = (f*(k-l))/(u-l);
+        newStats.f = lessFilterRows(rel, col, l, u, f, k);
     }
 
     return newStats;
@@ -430,7 +432,7 @@ Stats evalGreaterFilterStats(uint64_t rel, uint64_t col, uint64_t k) {
     }
     else {
         newStats.d = (d*(u-k))/(u-l);
-        newStats.f = (f*(u-k))/(u-l);
+        newStats.f = greaterFilterRows(rel, col, l, u, f, k);
     }
 
     return newStats;
@@ -510,7 +512,8 @@ Stats evalJoinStats(uint64_t relA, uint64_t colA, uint64_t relB, uint64_t colB)
         newStatsA.f = 0;
     }
     else {
-        newStatsA.f = (newStatsA.f*newStatsB.f)/n;
+        newStatsA.f = joinRows(relA, colA, newStatsA.f, relB, colB, newStatsB.f,
+                               newL, newU);
     }
 
     return newStatsA;
@@ -546,3 +549,121 @@ Stats ** copyStats(Stats ** target, Stats ** source, QueryInfo * queryInfo) {
     }
     return target;
 }
+
+// Fraction of all the rows of a column that have values in [l,u]
+static double histogramMass(Histogram * histogram, double l, double u){
+    return histogramBelow(histogram, u + 1) - histogramBelow(histogram, l);
+}
+
+// The filter 'col < k' with k clamped to u
+double lessFilterRows(uint64_t rel, uint64_t col, double l, double u,
+                      double f, double k){
+    if(k >= u)
+        return f;
+    Histogram * histogram = &r[rel].histograms[col];
+    double mass = histogramMass(histogram, l, u);
+    if(histogram->sampled == 0 || mass <= 0)
+        return (f*(k-l))/(u-l);
+    double below = histogramBelow(histogram, k) - histogramBelow(histogram, l);
+    return f * below / mass;
+}
+
+// The filter 'col > k' with k clamped to l
+double greaterFilterRows(uint64_t rel, uint64_t col, double l, double u,
+                         double f, double k){
+    if(k <= l)
+        return f;
+    Histogram * histogram = &r[rel].histograms[col];
+    double mass = histogramMass(histogram, l, u);
+    if(histogram->sampled == 0 || mass <= 0)
+        return (f*(u-k))/(u-l);
+    double above = histogramBelow(histogram, u + 1) -
+                   histogramBelow(histogram, k + 1);
+    return f * above / mass;
+}
+
+// The filter 'col = k' with k in [l,u]. Only the most common values are
+// known to be more frequent than the others, which share the rows the
+// common values in [l,u] leave evenly
+double equalFilterRows(uint64_t rel, uint64_t col, double l, double u,
+                       double f, double d, double k){
+    Histogram * histogram = &r[rel].histograms[col];
+    double mass = histogramMass(histogram, l, u);
+    if(histogram->sampled == 0 || mass <= 0)
+        return f/d;
+    double fraction = histogramMCV(histogram, k);
+    if(fraction >= 0)
+        return min(f, f * fraction / mass);
+
+    double rest = 1;
+    double others = d;
+    for(uint64_t j=0; j<histogram->mcvCount; j++)
+        if(histogram->mcv[j] >= l && histogram->mcv[j] <= u){
+            rest -= histogram->mcvFraction[j] / mass;
+            others--;
+        }
+    // Every distinct value was a common one, so k is rare at best
+    if(others < 1)
+        others = 1;
+    return f * max(rest, 0) / others;
+}
+
+// The join 'relA.colA = relB.colB' once both columns are cut to [l,u].
+// Pairs of the same common value are counted from their frequencies. A
+// common value meets the other column's less common values, and those
+// meet each other, as if they were spread evenly over [l,u]
+double joinRows(uint64_t relA, uint64_t colA, double fA,
+                uint64_t relB, uint64_t colB, double fB, double l, double u){
+    double n = u - l + 1;
+    Histogram * histogramA = &r[relA].histograms[colA];
+    Histogram * histogramB = &r[relB].histograms[colB];
+    double massA = histogramMass(histogramA, l, u);
+    double massB = histogramMass(histogramB, l, u);
+    if(histogramA->mcvCount == 0 || histogramB->mcvCount == 0 ||
+       massA <= 0 || massB <= 0)
+        return (fA*fB)/n;
+
+    double restA = 1;
+    double restB = 1;
+    for(uint64_t j=0; j<histogramA->mcvCount; j++)
+        if(histogramA->mcv[j] >= l && histogramA->mcv[j] <= u)
+            restA -= histogramA->mcvFraction[j] / massA;
+    for(uint64_t j=0; j<histogramB->mcvCount; j++)
+        if(histogramB->mcv[j] >= l && histogramB->mcv[j] <= u)
+            restB -= histogramB->mcvFraction[j] / massB;
+    restA = max(restA, 0);
+    restB = max(restB, 0);
+
+    double matches = restA * restB / n;
+    for(uint64_t j=0; j<histogramA->mcvCount; j++){
+        double value = histogramA->mcv[j];
+        if(value < l || value > u) continue;
+        double pA = histogramA->mcvFraction[j] / massA;
+        double pB = histogramMCV(histogramB, value);
+        matches += pB < 0 ? pA * restB / n : pA * pB / massB;
+    }
+    for(uint64_t j=0; j<histogramB->mcvCount; j++){
+        double value = histogramB->mcv[j];
+        if(value < l || value > u || histogramMCV(histogramA, value) >= 0)
+            continue;
+        matches += histogramB->mcvFraction[j] / massB * restA / n;
+    }
+    return fA * fB * matches;
+}
+
+// Estimated fraction of the rows of 'rel' that pass the filter 'col op k'
+double filterSelectivity(uint64_t rel, uint64_t col, char op, uint64_t k){
+    double l = r[rel].l[col];
+    double u = r[rel].u[col];
+    double d = r[rel].d[col];
+    double f = r[rel].f[col];
+
+    if(f == 0)
+        return 0;
+    if(op == '=')
+        return (k < l || k > u || d == 0) ? 0
+               : equalFilterRows(rel, col, l, u, f, d, k) / f;
+    if(op == '<')
+        return k <= l ? 0 : lessFilterRows(rel, col, l, u, f, min(k, u)) / f;
+    return k >= u ? 0 : greaterFilterRows(rel, col, l, u, f, max(k, l)) / f;
+}
@@ -38,5 +38,19 @@ Stats evalJoinStats(uint64_t relA, uint64_t colA, uint64_t relB, uint64_t colB);
 
 Stats ** copyStats(Stats ** target, Stats ** source, QueryInfo * queryInfo);
 
+// Rows left by a filter or a join on columns with 'f' rows whose values are
+// in [l,u]. They use the histograms and most common values of the columns
+// and fall back to values spread evenly over [l,u]
+double lessFilterRows(uint64_t rel, uint64_t col, double l, double u,
+                      double f, double k);
+double greaterFilterRows(uint64_t rel, uint64_t col, double l, double u,
+                         double f, double k);
+double equalFilterRows(uint64_t rel, uint64_t col, double l, double u,
+                       double f, double d, double k);
+double joinRows(uint64_t relA, uint64_t colA, double fA,
+                uint64_t relB, uint64_t colB, double fB, double l, double u);
+
+double filterSelectivity(uint64_t rel, uint64_t col, char op, uint64_t k);
+
 
 #endif
@@ -3,6 +3,12 @@
 #include "join/stats.hpp"
 #include "threads/scheduler.hpp"
 #include "join/optimizer.hpp"
+#include "join/index.hpp"
+#include "singleJoin/join.hpp"
+#include "singleJoin/pool.hpp"
+#include "singleJoin/simd.hpp"
+#include <cstring>
+#include <cerrno>
 
 //global
 Relation * r;
@@ -11,6 +17,7 @@ Stats ** stats;
 JobScheduler * myJobScheduler;
 extern uint64_t * histograms[4];
 extern uint64_t * psums[4];
+extern char forcedJoinMethod;
 
 // Intermediate IR;
 
@@ -40,16 +47,32 @@ void executeQueries() {
         //     printPredicate(&queryInfo->predicates[i]);
         // }
 
-        Intermediate * IR = new Intermediate;
-        for(uint64_t i=0; i<4; i++)
-            IR->results[i] = NULL;
-        IR->length = 0;
+        groupFilters(queryInfo);
+        planFactorization(queryInfo);
+        Intermediate * IR = newIntermediate(queryInfo->relationsCount);
 
-        for (uint64_t i = 0; i < queryInfo->predicatesCount; i++) {
-            execute(&queryInfo->predicates[i], queryInfo->relations, IR);
+        // A last join computes the sums itself instead of updating the IR
+        uint64_t count = queryInfo->predicatesCount;
+        bool fused = aggregatePushdown && count > 0 &&
+                     queryInfo->predicates[count - 1].predicateType == JOIN;
+        if(fused)
+            count--;
+
+        for (uint64_t i = 0, group; i < count; i += group) {
+            group = filterGroup(&queryInfo->predicates[i], count - i);
+            execute(&queryInfo->predicates[i], group, queryInfo->relations, IR);
         }
 
-        calculateSums(queryInfo, IR);
+        if(fused){
+            uint64_t * sums = executeJoinAggregate(&queryInfo->predicates[count],
+                                                   queryInfo, IR);
+            writeSums(queryInfo, sums);
+            delete[] sums;
+        }
+        else{
+            calculateSums(queryInfo, IR);
+        }
+        printPoolStats();
 
         // std::cerr << "Intermediate Results after query execution:" << '\n';
         // printResult(IR->results, IR->relCount);
@@ -63,7 +86,83 @@ void executeQueries() {
     free(line);
 }
 
-int main(void){
+// Options:
+//   --join=radix|sort-merge|shared|direct|auto
+//                          force a join method for every join. A direct join
+//                          is only used when its domain fits in memory
+//   --shared-threshold=N   largest small side joined without partitioning
+//   --no-aggregate         materialize the last join of a query and sum the
+//                          IR afterwards
+//   --no-packed            keep 64-bit keys and rowids in every radix join
+//   --no-factorize         flatten the output of every join into the IR
+//   --prefetch-distance=N  rows ahead that the IR gathers prefetch, at most
+//                          GATHER_PREFETCH_MAX_DISTANCE
+//   --prefault=populate|advise|off
+//                          map every page of the relations at load time, only
+//                          have the kernel read them ahead, or leave the
+//                          page faults to the queries
+//   --index=lazy|eager|off build the secondary index of a column the first
+//                          time a selective filter needs it, build all of
+//                          them at load time or never use them
+bool parseArguments(int argc, char ** argv){
+    for(int i=1; i<argc; i++){
+        if(strcmp(argv[i], "--join=radix") == 0)
+            forcedJoinMethod = RADIX_JOIN;
+        else if(strcmp(argv[i], "--join=sort-merge") == 0)
+            forcedJoinMethod = SORT_MERGE_JOIN;
+        else if(strcmp(argv[i], "--join=shared") == 0)
+            forcedJoinMethod = SHARED_HASH_JOIN;
+        else if(strcmp(argv[i], "--join=direct") == 0)
+            forcedJoinMethod = DIRECT_JOIN;
+        else if(strcmp(argv[i], "--join=auto") == 0)
+            forcedJoinMethod = AUTO_JOIN;
+        else if(strncmp(argv[i], "--shared-threshold=", 19) == 0)
+            sharedJoinThreshold = strtoull(argv[i] + 19, NULL, 10);
+        else if(strcmp(argv[i], "--no-aggregate") == 0)
+            aggregatePushdown = false;
+        else if(strcmp(argv[i], "--no-packed") == 0)
+            packedTuples = false;
+        else if(strcmp(argv[i], "--no-factorize") == 0)
+            factorizedJoins = false;
+        else if(strncmp(argv[i], "--prefetch-distance=", 20) == 0){
+            char * end;
+            errno = 0;
+            gatherPrefetchDistance = strtoull(argv[i] + 20, &end, 10);
+            if(errno != 0 || end == argv[i] + 20 || *end != '\0' ||
+               gatherPrefetchDistance > GATHER_PREFETCH_MAX_DISTANCE){
+                std::cerr << "Prefetch distance must be between 0 and "
+                          << GATHER_PREFETCH_MAX_DISTANCE << '\n';
+                return false;
+            }
+        }
+        else if(strcmp(argv[i], "--prefault=populate") == 0)
+            prefaultMode = PREFAULT_POPULATE;
+        else if(strcmp(argv[i], "--prefault=advise") == 0)
+            prefaultMode = PREFAULT_ADVISE;
+        else if(strcmp(argv[i], "--prefault=off") == 0)
+            prefaultMode = PREFAULT_OFF;
+        else if(strcmp(argv[i], "--index=lazy") == 0)
+            secondaryIndexes = INDEX_LAZY;
+        else if(strcmp(argv[i], "--index=eager") == 0)
+            secondaryIndexes = INDEX_EAGER;
+        else if(strcmp(argv[i], "--index=off") == 0)
+            secondaryIndexes = INDEX_OFF;
+        else{
+            std::cerr << "Unknown option " << argv[i] << '\n';
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char ** argv){
+    if(!parseArguments(argc, argv))
+        return -1;
+
+    // The relations are loaded in parallel jobs
+    myJobScheduler = new JobScheduler();
+    myJobScheduler->Init(4);
+
     mapAllData(&r, &relationsSize);
     stats = createStats();
 
@@ -76,8 +175,12 @@ int main(void){
     // if(relationsSize) printData(r[0]);
     std::cerr << '\n';
 
-    myJobScheduler = new JobScheduler();
-    myJobScheduler->Init(4);
+    std::cerr << "Probe kernel: " << selectProbeKernel() << '\n';
+    std::cerr << "Gather kernel: " << selectGatherKernel() << '\n';
+    std::cerr << "Filter kernel: " << selectFilterKernel() << '\n';
+
+    if(secondaryIndexes == INDEX_EAGER)
+        buildAllIndexes(r, relationsSize);
 
     //execute queries etc
     executeQueries();
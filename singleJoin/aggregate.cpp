@@ -0,0 +1,48 @@
+#include "aggregate.hpp"
+
+static inline uint64_t sumValue(AggregateSum * sum, uint64_t rowid){
+    return sum->rowids == NULL ? sum->values[rowid]
+                               : sum->values[sum->rowids[rowid]];
+}
+
+static inline uint64_t tupleWeight(uint64_t * weights, char side,
+                                   uint64_t rowid){
+    return weights == NULL || side != 0 ? 1 : weights[rowid];
+}
+
+// A probe tuple adds its own values once per match, so they are multiplied
+// by the weight of its matches instead of being looked up for every pair.
+// Sums wrap around the same way the per pair additions of calculateSums do
+void aggregateProbe(Column * big, uint64_t length, uint64_t start,
+                    HashIndex * index, bool flag,
+                    AggregateSum * requested, uint64_t sumsCount,
+                    uint64_t * weights, uint64_t * sums){
+    char bigSide = flag == 0 ? 0 : 1;
+    char smallSide = 1 - bigSide;
+    bool packed = isPacked(big);
+
+    for(uint64_t i=start; i<start+length; i++){
+        uint64_t value = packed ? packedKey(big->value[i]) : big->value[i];
+        uint64_t slot = h2(value, index->shift);
+        uint64_t bigRowid = packed ? packedRowid(big->value[i]) : big->rowid[i];
+        uint64_t bigWeight = tupleWeight(weights, bigSide, bigRowid);
+        uint64_t matched = 0;
+
+        uint64_t end = index->offsets[slot + 1];
+        for(uint64_t k=index->offsets[slot]; k<end; k++){
+            uint64_t key = packed ? packedKey(index->keys[k]) : index->keys[k];
+            if(key != value) continue;
+            uint64_t rowid = packed ? packedRowid(index->keys[k])
+                                    : index->rowids[k];
+            matched += tupleWeight(weights, smallSide, rowid);
+            for(uint64_t j=0; j<sumsCount; j++)
+                if(requested[j].side != bigSide)
+                    sums[j] += bigWeight * sumValue(&requested[j], rowid);
+        }
+
+        if(matched == 0) continue;
+        for(uint64_t j=0; j<sumsCount; j++)
+            if(requested[j].side == bigSide)
+                sums[j] += matched * sumValue(&requested[j], bigRowid);
+    }
+}
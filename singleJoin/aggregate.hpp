@@ -0,0 +1,28 @@
+#include "structs.hpp"
+#include "h2.hpp"
+
+#ifndef AGGREGATE_HPP
+#define AGGREGATE_HPP
+
+// One SUM of a query that ends with a join. The summed column belongs to
+// side A (0) or B (1) of the join. The value of the tuple with rowid 't' is
+// values[rowids[t]], or values[t] when the side is mapped data and its
+// rowids already are rows of the relation
+typedef struct AggregateSum{
+    char side;
+    uint64_t * values;
+    uint64_t * rowids;
+} AggregateSum;
+
+// Adds to 'sums' the requested sums over the matches of the tuples
+// [start, start+length) of 'big' with 'index'. A flag of 0 means that 'big'
+// is side A, as with compare(). When side A is a factorized IR, the tuple
+// with rowid 't' of A stands for weights[t] rows, so every match counts
+// that many times for the sums of B. The sums of A already hold the
+// weighted values. Otherwise 'weights' is NULL
+void aggregateProbe(Column * big, uint64_t length, uint64_t start,
+                    HashIndex * index, bool flag,
+                    AggregateSum * requested, uint64_t sumsCount,
+                    uint64_t * weights, uint64_t * sums);
+
+#endif // AGGREGATE_HPP
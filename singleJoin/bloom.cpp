@@ -0,0 +1,58 @@
+#include "bloom.hpp"
+#include "h2.hpp"
+
+// Mask of the bits a key sets in its block
+static inline uint64_t bloomPattern(uint64_t hash){
+    uint64_t pattern = 0;
+    for(uint64_t i=0; i<BLOOM_HASHES; i++)
+        pattern |= (uint64_t) 1 << ((hash >> (6 * i + 8)) & 63);
+    return pattern;
+}
+
+BloomFilter * buildBloomFilter(Column * column){
+    BloomFilter * filter = new BloomFilter;
+
+    // Power of two number of blocks, never fewer than two
+    uint64_t wanted = column->size * BLOOM_BITS_PER_KEY / 64;
+    uint64_t bits = 1;
+    while(((uint64_t) 1 << bits) < wanted) bits++;
+    filter->shift = 64 - bits;
+    filter->blocks = (uint64_t) 1 << bits;
+
+    filter->words = newAlignedArray(filter->blocks);
+    memset(filter->words, 0, filter->blocks * sizeof(uint64_t));
+
+    for(uint64_t i=0; i<column->size; i++){
+        uint64_t hash = column->value[i] * HASH_MULTIPLIER;
+        filter->words[hash >> filter->shift] |= bloomPattern(hash);
+    }
+
+    return filter;
+}
+
+void deleteBloomFilter(BloomFilter * filter){
+    if(filter == NULL) return;
+    deleteAlignedArray(filter->words);
+    delete filter;
+}
+
+uint64_t bloomScan(BloomFilter * filter, uint64_t * values, uint64_t start,
+                   uint64_t length, Column * out){
+    uint64_t * words = filter->words;
+    uint64_t shift = filter->shift;
+    uint64_t kept = start;
+
+    // Branch-free: every tuple is written and the cursor only moves past the
+    // ones that pass
+    for(uint64_t i=start; i<start+length; i++){
+        uint64_t value = values[i];
+        uint64_t hash = value * HASH_MULTIPLIER;
+        uint64_t pattern = bloomPattern(hash);
+
+        out->value[kept] = value;
+        out->rowid[kept] = i;
+        kept += (words[hash >> shift] & pattern) == pattern;
+    }
+
+    return kept - start;
+}
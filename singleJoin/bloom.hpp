@@ -0,0 +1,35 @@
+#include "structs.hpp"
+
+#ifndef BLOOM_HPP
+#define BLOOM_HPP
+
+// Bits of filter per key of the smaller side and bits set per key. All the
+// bits of a key fall in the same 64-bit block, so a lookup is one load
+#define BLOOM_BITS_PER_KEY 16
+#define BLOOM_HASHES 4
+
+// The filter is only worth building when the side scanned against it is at
+// least this many times larger than the side it is built on
+#define BLOOM_SIZE_RATIO 4
+
+// Number of jobs the scan of the larger side is split into
+#define BLOOM_SCAN_JOBS 16
+
+// Register-blocked Bloom filter. The high bits of the hash pick the block
+// and 4 groups of 6 lower bits pick the bits inside it
+typedef struct BloomFilter{
+    uint64_t shift;
+    uint64_t blocks;
+    uint64_t * words;
+} BloomFilter;
+
+BloomFilter * buildBloomFilter(Column * column);
+void deleteBloomFilter(BloomFilter * filter);
+
+// Keeps the tuples [start, start+length) of 'values' that may be in the
+// filter. Their values and rowids (the positions in 'values') are written
+// to 'out' from position 'start' on, and the number kept is returned
+uint64_t bloomScan(BloomFilter * filter, uint64_t * values, uint64_t start,
+                   uint64_t length, Column * out);
+
+#endif // BLOOM_HPP
@@ -0,0 +1,73 @@
+#include "direct.hpp"
+
+// Whether an index over [low, high] for buildSize tuples stays within the
+// memory budget
+bool directJoinFits(uint64_t low, uint64_t high, uint64_t buildSize){
+    if(high < low) return true;
+    uint64_t slots = high - low + 1;
+    if(slots > DIRECT_JOIN_MEMORY / sizeof(uint64_t)) return false;
+    return (slots + 1 + buildSize) * sizeof(uint64_t) <= DIRECT_JOIN_MEMORY;
+}
+
+// Count and scatter as in buildHashIndex, with the key minus 'low' as the
+// slot. Keys outside [low, high] can not match and are left out. The arrays
+// are allocated exactly, since the power of two classes of the pool could
+// double what directJoinFits allowed
+DirectIndex * buildDirectIndex(Column * rel, uint64_t low, uint64_t high){
+    DirectIndex * index = new DirectIndex;
+    index->low = low;
+    index->slots = high < low ? 0 : high - low + 1;
+
+    index->offsets = new uint64_t[index->slots + 1];
+    for(uint64_t i=0; i<=index->slots; i++)
+        index->offsets[i] = 0;
+
+    uint64_t kept = 0;
+    for(uint64_t i=0; i<rel->size; i++){
+        uint64_t slot = rel->value[i] - low;
+        if(slot < index->slots){
+            index->offsets[slot + 1]++;
+            kept++;
+        }
+    }
+
+    for(uint64_t i=1; i<=index->slots; i++)
+        index->offsets[i] += index->offsets[i-1];
+
+    index->rowids = new uint64_t[kept];
+    for(uint64_t i=0; i<rel->size; i++){
+        uint64_t slot = rel->value[i] - low;
+        if(slot < index->slots)
+            index->rowids[index->offsets[slot]++] = rel->rowid[i];
+    }
+    for(uint64_t i=index->slots; i>0; i--)
+        index->offsets[i] = index->offsets[i-1];
+    index->offsets[0] = 0;
+
+    return index;
+}
+
+void deleteDirectIndex(DirectIndex * index){
+    if(index == NULL) return;
+    delete[] index->offsets;
+    delete[] index->rowids;
+    delete index;
+}
+
+// Probes the tuples [start, start+length) of 'big'. As with compare(), the
+// cursor knows which side the rowids of 'big' belong to
+void directProbe(Column * big, uint64_t length, uint64_t start,
+                 DirectIndex * index, JoinCursor * cursor){
+    uint64_t low = index->low;
+    uint64_t slots = index->slots;
+    uint64_t * offsets = index->offsets;
+
+    for(uint64_t i=start; i<start+length; i++){
+        // Keys below 'low' wrap around and fail the bounds check as well
+        uint64_t slot = big->value[i] - low;
+        if(slot >= slots) continue;
+
+        for(uint64_t j=offsets[slot]; j<offsets[slot+1]; j++)
+            emitMatch(cursor, big->rowid[i], index->rowids[j]);
+    }
+}
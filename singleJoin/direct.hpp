@@ -0,0 +1,29 @@
+#include "structs.hpp"
+#include "result.hpp"
+
+#ifndef DIRECT_HPP
+#define DIRECT_HPP
+
+// A key domain is dense enough for a direct join when it has at most this
+// many values per tuple of the smaller side
+#define DIRECT_JOIN_DENSITY 4
+// Largest direct index (offsets and rowids) a join may allocate, in bytes
+#define DIRECT_JOIN_MEMORY (256 * 1024 * 1024ULL)
+
+// Index of the smaller side over the key domain [low, low + slots). The
+// tuples with key low + i are at positions [offsets[i], offsets[i+1]) of
+// 'rowids', so the keys themselves are never stored
+typedef struct DirectIndex{
+    uint64_t low;
+    uint64_t slots;
+    uint64_t * offsets;
+    uint64_t * rowids;
+} DirectIndex;
+
+bool directJoinFits(uint64_t low, uint64_t high, uint64_t buildSize);
+DirectIndex * buildDirectIndex(Column * rel, uint64_t low, uint64_t high);
+void deleteDirectIndex(DirectIndex * index);
+void directProbe(Column * big, uint64_t length, uint64_t start,
+                 DirectIndex * index, JoinCursor * cursor);
+
+#endif // DIRECT_HPP
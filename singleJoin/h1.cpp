@@ -1,13 +1,72 @@
 #include "h1.hpp"
 
-// Number of least significant bits that are used in the hash function
+// Default number of least significant bits that are used in the hash function
 #define BITS 8
 
+RadixPlan radixPlan = {BITS, 1, BITS, 0};
 uint64_t numberOfBuckets = 1 << BITS;
 
+// Returns floor(log2(value)) for value > 0
+static uint64_t log2Floor(uint64_t value){
+    uint64_t bits = 0;
+    while(value >>= 1) bits++;
+    return bits;
+}
+
+// Choose the total radix bits so that the build side of an average bucket
+// (value + rowid per tuple, plus about as much again for its h2 index) fits
+// in L2. A single pass can only scatter into as many partitions as it can
+// keep open in L1 (two output lines each) and in the TLB (one page each),
+// so larger fan-outs are split into two passes
+RadixPlan planPartitioning(uint64_t buildSize){
+    uint64_t tuplesPerBucket = L2_CACHE_SIZE / (4 * sizeof(uint64_t));
+    uint64_t maxPassBits = log2Floor(L1_CACHE_SIZE / (2 * CACHE_LINE_SIZE));
+    if(log2Floor(TLB_ENTRIES) < maxPassBits)
+        maxPassBits = log2Floor(TLB_ENTRIES);
+
+    uint64_t bits = 0;
+    while(bits < MAX_RADIX_BITS && (buildSize >> bits) > tuplesPerBucket)
+        bits++;
+    if(bits < MIN_RADIX_BITS) bits = MIN_RADIX_BITS;
+    if(bits > 2 * maxPassBits) bits = 2 * maxPassBits;
+
+    RadixPlan plan;
+    plan.bits = bits;
+    if(bits <= maxPassBits){
+        plan.passes = 1;
+        plan.bitsPass1 = bits;
+        plan.bitsPass2 = 0;
+    }
+    else{
+        plan.passes = 2;
+        plan.bitsPass1 = (bits + 1) / 2;
+        plan.bitsPass2 = bits - plan.bitsPass1;
+    }
+    return plan;
+}
+
+// Make the given plan the one used by every following partitioning
+void setRadixPlan(RadixPlan plan){
+    radixPlan = plan;
+    numberOfBuckets = (uint64_t) 1 << plan.bits;
+}
+
+void printRadixPlan(RadixPlan plan){
+    std::cerr << plan.bits << " radix bits in " << plan.passes;
+    if(plan.passes == 1)
+        std::cerr << " pass";
+    else
+        std::cerr << " passes (" << plan.bitsPass1 << "+" << plan.bitsPass2 << ")";
+}
+
 // Hash fucntion
 uint64_t h1(uint64_t value){
-    return value & ((1 << BITS) - 1);
+    return value & (numberOfBuckets - 1);
+}
+
+// Hash function of a single partitioning pass
+uint64_t h1Radix(uint64_t value, uint64_t shift, uint64_t mask){
+    return (value >> shift) & mask;
 }
 
 // Takes a Column & returns an array with the num of tuples in each bucket
@@ -35,7 +94,7 @@ uint64_t * calculateStartingPositions(uint64_t * histogram){
     return startingPositions;
 }
 
-// Print a given histogram (works with every uint64_t array of size = 1<<BITS)
+// Print a given histogram (works with every uint64_t array of size = numberOfBuckets)
 void printHistogram(uint64_t * histogram){
     for(uint64_t i=0; i<numberOfBuckets; i++)
         std::cerr << i << ". " << histogram[i] << std::endl;
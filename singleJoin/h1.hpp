@@ -1,6 +1,38 @@
 #include "structs.hpp"
 
+#ifndef H1_HPP
+#define H1_HPP
+
+// Hardware parameters used to size the radix partitioning
+#define CACHE_LINE_SIZE 64
+#define L1_CACHE_SIZE (32 * 1024)
+#define L2_CACHE_SIZE (256 * 1024)
+#define TLB_ENTRIES 64
+
+// Bounds for the total number of radix bits of a join
+#define MIN_RADIX_BITS 4
+#define MAX_RADIX_BITS 12
+
+// Describes how a join partitions its inputs. With two passes the first one
+// scatters on the high 'bitsPass1' bits of the radix and the second one
+// refines every partition on the low 'bitsPass2' bits, so the final bucket of
+// a value is always h1(value) regardless of the number of passes
+typedef struct RadixPlan{
+    uint64_t bits;
+    uint64_t passes;
+    uint64_t bitsPass1;
+    uint64_t bitsPass2;
+} RadixPlan;
+
+extern RadixPlan radixPlan;
+extern uint64_t numberOfBuckets;
+
+RadixPlan planPartitioning(uint64_t buildSize);
+void setRadixPlan(RadixPlan plan);
+void printRadixPlan(RadixPlan plan);
+
 uint64_t h1(uint64_t value);
+uint64_t h1Radix(uint64_t value, uint64_t shift, uint64_t mask);
 uint64_t * calculateHistogram(Column * rel);
 uint64_t * calculateStartingPositions(uint64_t * histogram);
 void printHistogram(uint64_t * histogram);
@@ -8,3 +40,5 @@ Column * order(Column * rel, uint64_t * startingPositions);
 Column * bucketify(Column * rel,
                   uint64_t ** histogram,
                   uint64_t ** startingPositions);
+
+#endif // H1_HPP
@@ -1,6 +1,103 @@
 #include "h2.hpp"
+#include "pool.hpp"
 
-uint64_t h2(uint64_t value, uint64_t prime){
+// Multiplicative hash into a table of 2^(64 - shift) slots
+uint64_t h2(uint64_t value, uint64_t shift){
+    return (value * HASH_MULTIPLIER) >> shift;
+}
+
+// Builds the index of the bucket [startingPos, startingPos + bucketSize) of
+// 'rel' with a counting pass and a scatter pass, so every insertion is O(1)
+// no matter how many duplicates a key has
+HashIndex * buildHashIndex(Column * rel, uint64_t bucketSize, uint64_t startingPos){
+    if(isPacked(rel))
+        return buildPackedHashIndex(rel, bucketSize, startingPos);
+
+    HashIndex * index = new HashIndex;
+
+    // At least as many slots as tuples, and never fewer than two
+    uint64_t bits = 1;
+    while(((uint64_t) 1 << bits) < bucketSize) bits++;
+    index->shift = 64 - bits;
+    index->slots = (uint64_t) 1 << bits;
+    index->size = bucketSize;
+
+    index->offsets = poolAlloc(index->slots + 1);
+    index->keys = poolAlloc(bucketSize);
+    index->rowids = poolAlloc(bucketSize);
+
+    for(uint64_t i=0; i<=index->slots; i++)
+        index->offsets[i] = 0;
+
+    // Count the tuples of every slot, one position ahead of the slot
+    uint64_t * values = rel->value + startingPos;
+    for(uint64_t i=0; i<bucketSize; i++)
+        index->offsets[h2(values[i], index->shift) + 1]++;
+
+    for(uint64_t i=1; i<=index->slots; i++)
+        index->offsets[i] += index->offsets[i-1];
+
+    // Scatter using the start of every slot as its cursor. Afterwards
+    // offsets[i] holds the end of slot i, so shift them back by one
+    uint64_t * rowids = rel->rowid + startingPos;
+    for(uint64_t i=0; i<bucketSize; i++){
+        uint64_t pos = index->offsets[h2(values[i], index->shift)]++;
+        index->keys[pos] = values[i];
+        index->rowids[pos] = rowids[i];
+    }
+    for(uint64_t i=index->slots; i>0; i--)
+        index->offsets[i] = index->offsets[i-1];
+    index->offsets[0] = 0;
+
+    return index;
+}
+
+// Same index over packed tuples. They are stored whole in 'keys', so a
+// probe reads the key and the rowid of a candidate with one load
+HashIndex * buildPackedHashIndex(Column * rel, uint64_t bucketSize,
+                                 uint64_t startingPos){
+    HashIndex * index = new HashIndex;
+
+    uint64_t bits = 1;
+    while(((uint64_t) 1 << bits) < bucketSize) bits++;
+    index->shift = 64 - bits;
+    index->slots = (uint64_t) 1 << bits;
+    index->size = bucketSize;
+
+    index->offsets = poolAlloc(index->slots + 1);
+    index->keys = poolAlloc(bucketSize);
+    index->rowids = NULL;
+
+    for(uint64_t i=0; i<=index->slots; i++)
+        index->offsets[i] = 0;
+
+    uint64_t * tuples = rel->value + startingPos;
+    for(uint64_t i=0; i<bucketSize; i++)
+        index->offsets[h2(packedKey(tuples[i]), index->shift) + 1]++;
+
+    for(uint64_t i=1; i<=index->slots; i++)
+        index->offsets[i] += index->offsets[i-1];
+
+    for(uint64_t i=0; i<bucketSize; i++){
+        uint64_t pos = index->offsets[h2(packedKey(tuples[i]), index->shift)]++;
+        index->keys[pos] = tuples[i];
+    }
+    for(uint64_t i=index->slots; i>0; i--)
+        index->offsets[i] = index->offsets[i-1];
+    index->offsets[0] = 0;
+
+    return index;
+}
+
+void deleteHashIndex(HashIndex * index){
+    if(index == NULL) return;
+    poolFree(index->offsets);
+    poolFree(index->keys);
+    poolFree(index->rowids);
+    delete index;
+}
+
+uint64_t h2Prime(uint64_t value, uint64_t prime){
     // uint64_t prime = nextPrime(start);
     return value % prime;
 }
@@ -75,7 +172,7 @@ void bucketify2(Column * rel,
     for (uint64_t i = startingPos + bucketSize - 1; i >= startingPos; i--) {
 
         // Get the hashed value
-        uint64_t hashValue = h2(rel->value[i], prime);
+        uint64_t hashValue = h2Prime(rel->value[i], prime);
 
         // If the corresponding bucket is currently empty
         if ((*bucketArray)[hashValue] == (uint64_t) -1) {
@@ -103,7 +200,7 @@ void bucketify2(Column * rel,
     // for (uint64_t i = startingPos; i < bucketSize + startingPos; i++) {
     //     std::cerr << "\t"<<  i - startingPos  << ": "
     //     << rel->value[i] << ": "
-    //     << h2(rel->value[i], prime) << ": "
+    //     << h2Prime(rel->value[i], prime) << ": "
     //     << prime << std::endl;
     // }
     // std::cerr << std::endl;
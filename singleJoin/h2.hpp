@@ -1,13 +1,43 @@
 #include "structs.hpp"
 
-uint64_t h2(uint64_t value, uint64_t start);
+#ifndef H2_HPP
+#define H2_HPP
+
+// Fibonacci hashing constant (2^64 / golden ratio). The high bits of the
+// product depend on every bit of the key, which matters since all the keys
+// of an h1 bucket share their low bits
+#define HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+// Index of a bucket of the smaller side. The table has a power of two number
+// of slots and the tuples of slot i are stored contiguously at positions
+// [offsets[i], offsets[i+1]) of 'keys' and 'rowids'. The index of a packed
+// Column keeps whole packed tuples in 'keys' and has no 'rowids'
+typedef struct HashIndex{
+    uint64_t shift;
+    uint64_t slots;
+    uint64_t size;
+    uint64_t * offsets;
+    uint64_t * keys;
+    uint64_t * rowids;
+} HashIndex;
+
+uint64_t h2(uint64_t value, uint64_t shift);
+HashIndex * buildHashIndex(Column * rel, uint64_t bucketSize, uint64_t startingPos);
+HashIndex * buildPackedHashIndex(Column * rel, uint64_t bucketSize,
+                                 uint64_t startingPos);
+void deleteHashIndex(HashIndex * index);
+
+// Chained index on a prime sized table, kept as the baseline of h2Bench
+uint64_t h2Prime(uint64_t value, uint64_t prime);
 uint64_t nextPrime(uint64_t start);
 bool isPrime(uint64_t i);
 
-void tesNextPrime(uint64_t upTo);
+void testNextPrime(uint64_t upTo);
 
 void bucketify2 (Column * rel,
                     uint64_t bucket_size,
                     uint64_t start,
                     uint64_t ** bucket_array,
                     uint64_t ** chain_array);
+
+#endif // H2_HPP
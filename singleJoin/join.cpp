@@ -1,34 +1,40 @@
 #include "join.hpp"
+#include "simd.hpp"
+#include "../threads/scheduler.hpp"
+#include <immintrin.h>
 
 extern uint64_t numberOfBuckets;
+extern JobScheduler * myJobScheduler;
 
 uint64_t * globalHistA;
 uint64_t * globalPsumA;
 uint64_t * globalHistB;
 uint64_t * globalPsumB;
 
-Result *** globalResults;
+// Output of the join that is running and the offset of every job in it.
+// While the jobs only count their matches the output is NULL
+JoinResult * globalOutput;
+uint64_t * globalOffsets;
 
 Column * orderedA;
 Column * orderedB;
 
+uint64_t sharedJoinThreshold = SHARED_JOIN_THRESHOLD;
+
 #define USE_THREADS 1
 
-Result ** join(Column * A, Column * B){
-    if(USE_THREADS){
-        orderedA = bucketifyThread(A, &globalHistA, &globalPsumA);
-        orderedB = bucketifyThread(B, &globalHistB, &globalPsumB);
+// With 'packed' both sides are partitioned as packed tuples, which halves
+// the memory traffic of partitioning, building and probing
+JoinResult * join(Column * A, Column * B, bool packed){
+    // Size the partitioning after the smaller side, which every bucket
+    // will build its h2 index on
+    setRadixPlan(planPartitioning(A->size < B->size ? A->size : B->size));
 
-        globalResults = new Result**[numberOfBuckets];
-        threadJoin(numberOfBuckets);
-        Result ** threadResult = convertResult(numberOfBuckets);
+    if(USE_THREADS){
+        orderedA = bucketifyThread(A, &globalHistA, &globalPsumA, packed);
+        orderedB = bucketifyThread(B, &globalHistB, &globalPsumB, packed);
 
-        for(uint64_t i=0; i<numberOfBuckets; i++){
-            deleteResult(globalResults[i][0]);
-            deleteResult(globalResults[i][1]);
-            delete[] globalResults[i];
-        }
-        delete[] globalResults;
+        JoinResult * threadResult = threadJoin(numberOfBuckets);
 
         deleteColumn(orderedA);
         delete[] globalHistA;
@@ -50,36 +56,37 @@ Result ** join(Column * A, Column * B){
         uint64_t * startingPosB;
         Column * orderedB = bucketify(B, &histogramB, &startingPosB);
 
-        uint64_t * bucketArray;
-        uint64_t * chainArray;
-        Result ** result = new Result*[2];
-        result[0] = newResult();
-        result[1] = newResult();
-        for (uint64_t i = 0; i < numberOfBuckets; i++) {
-            if(histogramA[i] == 0 || histogramB[i] == 0){
-                //the one bucket is empty so there is nothing to compare with
-                //the other bucket
-                continue;
-            }
-            // For each bucket find the smaller one and make an index with h2 for
-            // that one. Then find the equal values and store them in result
-            if (histogramA[i] >= histogramB[i]) {
-                bucketify2(orderedB, histogramB[i], startingPosB[i], &bucketArray, &chainArray);
-                compare(orderedA, orderedB, histogramA[i], startingPosA[i], histogramB[i], \
-                    startingPosB[i], bucketArray, chainArray, result, 0);
-            }
-            else {
-                bucketify2(orderedA, histogramA[i], startingPosA[i], &bucketArray, &chainArray);
-                compare(orderedB, orderedA, histogramB[i], startingPosB[i], histogramA[i], \
-                    startingPosA[i], bucketArray, chainArray, result, 1);
-            }
+        // The first pass only counts the matches, the second one writes them
+        JoinResult * result = NULL;
+        for (int pass = 0; pass < 2; pass++) {
+            uint64_t pos = 0;
+            for (uint64_t i = 0; i < numberOfBuckets; i++) {
+                if(histogramA[i] == 0 || histogramB[i] == 0){
+                    //the one bucket is empty so there is nothing to compare with
+                    //the other bucket
+                    continue;
+                }
+                // For each bucket find the smaller one and make an index with h2 for
+                // that one. Then find the equal values and store them in result
+                HashIndex * index;
+                bool flag = histogramA[i] < histogramB[i];
+                JoinCursor bucket = newJoinCursor(result, flag, pos);
+                if (flag == 0) {
+                    index = buildHashIndex(orderedB, histogramB[i], startingPosB[i]);
+                    compare(orderedA, histogramA[i], startingPosA[i], index, &bucket);
+                }
+                else {
+                    index = buildHashIndex(orderedA, histogramA[i], startingPosA[i]);
+                    compare(orderedB, histogramB[i], startingPosB[i], index, &bucket);
+                }
+                pos = bucket.pos;
 
-            delete[] bucketArray;
-            delete[] chainArray;
+                deleteHashIndex(index);
+            }
+            if (result == NULL)
+                result = newJoinResult(pos);
         }
 
-        //printDoubleResult(result);
-
         deleteColumn(orderedA);
         delete[] histogramA;
         delete[] startingPosA;
@@ -92,69 +99,472 @@ Result ** join(Column * A, Column * B){
     }
 }
 
+// Kernels used by compare, for plain and for packed Columns. They stay
+// scalar unless selectProbeKernel finds a vector extension at startup
+ProbeKernel probeKernel = compareScalar;
+ProbeKernel packedProbeKernel = comparePackedScalar;
+
+static void initCompressLUT();
+
+// Picks the widest probe kernels the CPU supports and returns their name
+const char * selectProbeKernel(){
+    initCompressLUT();
+    if(cpuHasAVX512()){
+        probeKernel = compareAVX512;
+        packedProbeKernel = comparePackedAVX512;
+        return "avx512";
+    }
+    if(cpuHasAVX2()){
+        probeKernel = compareAVX2;
+        packedProbeKernel = comparePackedAVX2;
+        return "avx2";
+    }
+    probeKernel = compareScalar;
+    packedProbeKernel = comparePackedScalar;
+    return "scalar";
+}
+
 void compare(Column * orderedBig,
-            Column * orderedSmall,
             uint64_t bucketSizeBig,
             uint64_t startIndexBig,
-            uint64_t bucketSizeSmall,
-            uint64_t startIndexSmall,
-            uint64_t * bucketArray,
-            uint64_t * chainArray,
-            Result ** result,
-            bool flag) {
-
-    int hash_value, prime = nextPrime(bucketSizeSmall);
+            HashIndex * index,
+            JoinCursor * cursor) {
+    if (isPacked(orderedBig))
+        packedProbeKernel(orderedBig, bucketSizeBig, startIndexBig, index, cursor);
+    else
+        probeKernel(orderedBig, bucketSizeBig, startIndexBig, index, cursor);
+}
+
+void compareScalar(Column * orderedBig,
+                   uint64_t bucketSizeBig,
+                   uint64_t startIndexBig,
+                   HashIndex * index,
+                   JoinCursor * cursor) {
+
     // Compare every value of the bigger Column with the values of the smaller
     // one but are on the same bucket of h2
     for (uint64_t i = startIndexBig;
                   i < bucketSizeBig + startIndexBig;
                   i++) {
-        hash_value = h2(orderedBig->value[i], prime);
+        uint64_t hash_value = h2(orderedBig->value[i], index->shift);
         checkEquals(orderedBig->rowid[i], orderedBig->value[i], hash_value, \
-                    orderedSmall, startIndexSmall, bucketArray, chainArray, \
-                    result, flag, i);
+                    index, cursor);
     }
 }
 
-void checkEquals(uint64_t rowidA,
-                 uint64_t valueA,
-                 int hash_value,
-                 Column * orderedSmall,
-                 uint64_t startIndexSmall,
-                 uint64_t * bucketArray,
-                 uint64_t * chainArray,
-                 Result ** result,
-                 bool flag,
-                 int rowIdBig) {
-
-    uint64_t rowidB;
-    uint64_t valueB;
-    // Get the rowId of the first value in the current bucket
-    int rowIdSmall = bucketArray[hash_value], normRowId;
-    while (rowIdSmall != -1) {
-        // We need to normalse the rowid because it has values from -1 to
-        // the size of the bucket but we are using the actual array
-        normRowId = rowIdSmall + startIndexSmall;
-        // Get the value from the bigger array
-        rowidB = orderedSmall->rowid[normRowId];
-        valueB = orderedSmall->value[normRowId];
-        // Compare the values and add them in the list if they are wqual
-        if (valueA == valueB) {
-            // We need this flag so we will know which rowId goes first and
-            // which second
-            if (flag == 0) {
-                insertSingleResult(result[0], rowidA);
-                insertSingleResult(result[1], rowidB);
+// Append the matches that a vector kernel compressed into 'big' and 'small'
+static void insertMatches(JoinCursor * cursor, uint64_t * big,
+                          uint64_t * small, uint64_t count){
+    if (cursor->big == NULL) {
+        cursor->pos += count;
+        return;
+    }
+    memcpy(cursor->big + cursor->pos, big, count * sizeof(uint64_t));
+    memcpy(cursor->small + cursor->pos, small, count * sizeof(uint64_t));
+    cursor->pos += count;
+}
+
+// Low 64 bits of the lane-wise product, since AVX2 has no 64-bit mullo
+__attribute__((target("avx2")))
+static inline __m256i mullo64AVX2(__m256i a, __m256i b){
+    __m256i cross = _mm256_mullo_epi32(a, _mm256_shuffle_epi32(b, 0xB1));
+    cross = _mm256_add_epi32(cross, _mm256_srli_epi64(cross, 32));
+    cross = _mm256_slli_epi64(cross, 32);
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b), cross);
+}
+
+// Permutations that move the selected 64-bit lanes of a 4 lane mask to the
+// front, expressed as pairs of 32-bit lane indexes for permutevar8x32.
+// selectProbeKernel fills it once at startup, before any probe job runs
+static int compressLUT[16][8];
+
+static void initCompressLUT(){
+    for (int mask = 0; mask < 16; mask++) {
+        int out = 0;
+        for (int lane = 0; lane < 4; lane++) {
+            if (mask & (1 << lane)) {
+                compressLUT[mask][2 * out] = 2 * lane;
+                compressLUT[mask][2 * out + 1] = 2 * lane + 1;
+                out++;
+            }
+        }
+        for (; out < 4; out++) {
+            compressLUT[mask][2 * out] = 0;
+            compressLUT[mask][2 * out + 1] = 1;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static inline void compressStoreAVX2(uint64_t * dst, int mask, __m256i v){
+    __m256i perm = _mm256_loadu_si256((const __m256i *) compressLUT[mask]);
+    _mm256_storeu_si256((__m256i *) dst, _mm256_permutevar8x32_epi32(v, perm));
+}
+
+// Every lane follows the slot of its own probe key. Lanes whose slot is
+// exhausted stay masked off until all four are done
+__attribute__((target("avx2")))
+void compareAVX2(Column * orderedBig,
+                 uint64_t bucketSizeBig,
+                 uint64_t startIndexBig,
+                 HashIndex * index,
+                 JoinCursor * cursor) {
+    uint64_t big[4];
+    uint64_t small[4];
+    const long long * offsets = (const long long *) index->offsets;
+    const long long * keys = (const long long *) index->keys;
+    const long long * rowids = (const long long *) index->rowids;
+    __m256i multiplier = _mm256_set1_epi64x((long long) HASH_MULTIPLIER);
+    __m128i shift = _mm_cvtsi64_si128((long long) index->shift);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i all = _mm256_set1_epi64x(-1);
+    __m256i one = _mm256_set1_epi64x(1);
+
+    uint64_t i = startIndexBig;
+    uint64_t end = startIndexBig + bucketSizeBig;
+    for (; i + 4 <= end; i += 4) {
+        __m256i values = _mm256_loadu_si256((const __m256i *) (orderedBig->value + i));
+        __m256i rowidsBig = _mm256_loadu_si256((const __m256i *) (orderedBig->rowid + i));
+
+        __m256i slot = _mm256_srl_epi64(mullo64AVX2(values, multiplier), shift);
+        __m256i pos = _mm256_mask_i64gather_epi64(zero, offsets, slot, all, 8);
+        __m256i last = _mm256_mask_i64gather_epi64(zero, offsets + 1, slot, all, 8);
+        __m256i active = _mm256_cmpgt_epi64(last, pos);
+
+        while (!_mm256_testz_si256(active, active)) {
+            __m256i candidates = _mm256_mask_i64gather_epi64(zero, keys, pos,
+                                                             active, 8);
+            __m256i hits = _mm256_and_si256(active, _mm256_cmpeq_epi64(candidates, values));
+            int mask = _mm256_movemask_pd(_mm256_castsi256_pd(hits));
+            if (mask) {
+                __m256i rowidsSmall = _mm256_mask_i64gather_epi64(zero, rowids, pos,
+                                                                  hits, 8);
+                compressStoreAVX2(big, mask, rowidsBig);
+                compressStoreAVX2(small, mask, rowidsSmall);
+                insertMatches(cursor, big, small, __builtin_popcount(mask));
+            }
+            pos = _mm256_add_epi64(pos, _mm256_and_si256(active, one));
+            active = _mm256_cmpgt_epi64(last, pos);
+        }
+    }
+
+    // Leftover tuples that do not fill a vector
+    compareScalar(orderedBig, end - i, i, index, cursor);
+}
+
+__attribute__((target("avx512f,avx512dq")))
+void compareAVX512(Column * orderedBig,
+                   uint64_t bucketSizeBig,
+                   uint64_t startIndexBig,
+                   HashIndex * index,
+                   JoinCursor * cursor) {
+    uint64_t big[8];
+    uint64_t small[8];
+    __m512i multiplier = _mm512_set1_epi64((long long) HASH_MULTIPLIER);
+    __m128i shift = _mm_cvtsi64_si128((long long) index->shift);
+    __m512i zero = _mm512_setzero_si512();
+    __m512i one = _mm512_set1_epi64(1);
+
+    uint64_t i = startIndexBig;
+    uint64_t end = startIndexBig + bucketSizeBig;
+    for (; i + 8 <= end; i += 8) {
+        __m512i values = _mm512_loadu_si512(orderedBig->value + i);
+        __m512i rowidsBig = _mm512_loadu_si512(orderedBig->rowid + i);
+
+        __m512i slot = _mm512_maskz_srl_epi64(0xFF, _mm512_mullo_epi64(values, multiplier),
+                                              shift);
+        __m512i pos = _mm512_mask_i64gather_epi64(zero, 0xFF, slot, index->offsets, 8);
+        __m512i last = _mm512_mask_i64gather_epi64(zero, 0xFF, slot, index->offsets + 1, 8);
+        __mmask8 active = _mm512_cmplt_epu64_mask(pos, last);
+
+        while (active) {
+            __m512i candidates = _mm512_mask_i64gather_epi64(zero, active, pos,
+                                                             index->keys, 8);
+            __mmask8 hits = _mm512_mask_cmpeq_epu64_mask(active, candidates, values);
+            if (hits) {
+                __m512i rowidsSmall = _mm512_mask_i64gather_epi64(zero, hits, pos,
+                                                                  index->rowids, 8);
+                _mm512_mask_compressstoreu_epi64(big, hits, rowidsBig);
+                _mm512_mask_compressstoreu_epi64(small, hits, rowidsSmall);
+                insertMatches(cursor, big, small, __builtin_popcount(hits));
+            }
+            pos = _mm512_mask_add_epi64(pos, active, pos, one);
+            active = _mm512_mask_cmplt_epu64_mask(active, pos, last);
+        }
+    }
+
+    // Leftover tuples that do not fill a vector
+    compareScalar(orderedBig, end - i, i, index, cursor);
+}
+
+// Probe kernels of a packed Column against the index of a packed Column.
+// Keys are compared on the low half of the tuples and the rowids of a
+// match are their high halves
+void comparePackedScalar(Column * orderedBig,
+                         uint64_t bucketSizeBig,
+                         uint64_t startIndexBig,
+                         HashIndex * index,
+                         JoinCursor * cursor) {
+    for (uint64_t i = startIndexBig;
+                  i < bucketSizeBig + startIndexBig;
+                  i++) {
+        uint64_t tuple = orderedBig->value[i];
+        uint64_t key = packedKey(tuple);
+        uint64_t slot = h2(key, index->shift);
+
+        uint64_t end = index->offsets[slot + 1];
+        for (uint64_t k = index->offsets[slot]; k < end; k++) {
+            if (packedKey(index->keys[k]) == key)
+                emitMatch(cursor, packedRowid(tuple), packedRowid(index->keys[k]));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void comparePackedAVX2(Column * orderedBig,
+                       uint64_t bucketSizeBig,
+                       uint64_t startIndexBig,
+                       HashIndex * index,
+                       JoinCursor * cursor) {
+    uint64_t big[4];
+    uint64_t small[4];
+    const long long * offsets = (const long long *) index->offsets;
+    const long long * tuples = (const long long *) index->keys;
+    __m256i multiplier = _mm256_set1_epi64x((long long) HASH_MULTIPLIER);
+    __m256i keyMask = _mm256_set1_epi64x((long long) PACKED_KEY_MASK);
+    __m128i shift = _mm_cvtsi64_si128((long long) index->shift);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i all = _mm256_set1_epi64x(-1);
+    __m256i one = _mm256_set1_epi64x(1);
+
+    uint64_t i = startIndexBig;
+    uint64_t end = startIndexBig + bucketSizeBig;
+    for (; i + 4 <= end; i += 4) {
+        __m256i packed = _mm256_loadu_si256((const __m256i *) (orderedBig->value + i));
+        __m256i values = _mm256_and_si256(packed, keyMask);
+        __m256i rowidsBig = _mm256_srli_epi64(packed, 32);
+
+        __m256i slot = _mm256_srl_epi64(mullo64AVX2(values, multiplier), shift);
+        __m256i pos = _mm256_mask_i64gather_epi64(zero, offsets, slot, all, 8);
+        __m256i last = _mm256_mask_i64gather_epi64(zero, offsets + 1, slot, all, 8);
+        __m256i active = _mm256_cmpgt_epi64(last, pos);
+
+        while (!_mm256_testz_si256(active, active)) {
+            __m256i candidates = _mm256_mask_i64gather_epi64(zero, tuples, pos,
+                                                             active, 8);
+            __m256i hits = _mm256_and_si256(active,
+                               _mm256_cmpeq_epi64(_mm256_and_si256(candidates, keyMask),
+                                                  values));
+            int mask = _mm256_movemask_pd(_mm256_castsi256_pd(hits));
+            if (mask) {
+                compressStoreAVX2(big, mask, rowidsBig);
+                compressStoreAVX2(small, mask, _mm256_srli_epi64(candidates, 32));
+                insertMatches(cursor, big, small, __builtin_popcount(mask));
             }
-            else{
-                insertSingleResult(result[0], rowidB);
-                insertSingleResult(result[1], rowidA);
+            pos = _mm256_add_epi64(pos, _mm256_and_si256(active, one));
+            active = _mm256_cmpgt_epi64(last, pos);
+        }
+    }
+
+    // Leftover tuples that do not fill a vector
+    comparePackedScalar(orderedBig, end - i, i, index, cursor);
+}
+
+__attribute__((target("avx512f,avx512dq")))
+void comparePackedAVX512(Column * orderedBig,
+                         uint64_t bucketSizeBig,
+                         uint64_t startIndexBig,
+                         HashIndex * index,
+                         JoinCursor * cursor) {
+    uint64_t big[8];
+    uint64_t small[8];
+    __m512i multiplier = _mm512_set1_epi64((long long) HASH_MULTIPLIER);
+    __m512i keyMask = _mm512_set1_epi64((long long) PACKED_KEY_MASK);
+    __m128i shift = _mm_cvtsi64_si128((long long) index->shift);
+    __m512i zero = _mm512_setzero_si512();
+    __m512i one = _mm512_set1_epi64(1);
+
+    uint64_t i = startIndexBig;
+    uint64_t end = startIndexBig + bucketSizeBig;
+    for (; i + 8 <= end; i += 8) {
+        __m512i packed = _mm512_loadu_si512(orderedBig->value + i);
+        __m512i values = _mm512_and_si512(packed, keyMask);
+        __m512i rowidsBig = _mm512_maskz_srli_epi64(0xFF, packed, 32);
+
+        __m512i slot = _mm512_maskz_srl_epi64(0xFF, _mm512_mullo_epi64(values, multiplier),
+                                              shift);
+        __m512i pos = _mm512_mask_i64gather_epi64(zero, 0xFF, slot, index->offsets, 8);
+        __m512i last = _mm512_mask_i64gather_epi64(zero, 0xFF, slot, index->offsets + 1, 8);
+        __mmask8 active = _mm512_cmplt_epu64_mask(pos, last);
+
+        while (active) {
+            __m512i candidates = _mm512_mask_i64gather_epi64(zero, active, pos,
+                                                             index->keys, 8);
+            __mmask8 hits = _mm512_mask_cmpeq_epu64_mask(active,
+                                _mm512_and_si512(candidates, keyMask), values);
+            if (hits) {
+                _mm512_mask_compressstoreu_epi64(big, hits, rowidsBig);
+                _mm512_mask_compressstoreu_epi64(small, hits,
+                                                 _mm512_maskz_srli_epi64(0xFF, candidates, 32));
+                insertMatches(cursor, big, small, __builtin_popcount(hits));
             }
+            pos = _mm512_mask_add_epi64(pos, active, pos, one);
+            active = _mm512_mask_cmplt_epu64_mask(active, pos, last);
+        }
+    }
+
+    // Leftover tuples that do not fill a vector
+    comparePackedScalar(orderedBig, end - i, i, index, cursor);
+}
+
+void checkEquals(uint64_t rowidA,
+                 uint64_t valueA,
+                 uint64_t hash_value,
+                 HashIndex * index,
+                 JoinCursor * cursor) {
+
+    // The tuples of the slot are stored next to each other in the index
+    uint64_t end = index->offsets[hash_value + 1];
+    for (uint64_t i = index->offsets[hash_value]; i < end; i++) {
+        // Compare the values and add them in the list if they are wqual.
+        // The cursor knows which side the rowids belong to
+        if (valueA == index->keys[i])
+            emitMatch(cursor, rowidA, index->rowids[i]);
+    }
+
+}
+
+JoinResult * allocateJoinOutput(uint64_t * offsets, uint64_t jobs){
+    uint64_t total = 0;
+    for(uint64_t i=0; i<jobs; i++){
+        uint64_t count = offsets[i];
+        offsets[i] = total;
+        total += count;
+    }
+    return newJoinResult(total);
+}
+
+// Non-partitioned join for a small side that fits in the cache as a whole.
+// Its index is built once and the bigger side is probed in place by
+// parallel slices, so neither side goes through bucketifyThread
+JoinResult * sharedJoin(Column * A, Column * B){
+    Column * small = A->size < B->size ? A : B;
+    Column * big = A->size < B->size ? B : A;
+    bool flag = big == B;
+
+    HashIndex * index = buildHashIndex(small, small->size, 0);
+
+    uint64_t chunk = big->size / (4 * SKEW_SPLIT_FACTOR);
+    if(chunk < MIN_PROBE_CHUNK) chunk = MIN_PROBE_CHUNK;
+    uint64_t resultsCount = (big->size + chunk - 1) / chunk;
+    if(resultsCount == 0) resultsCount = 1;
+
+    // The slices are probed twice, first to count and then to write
+    globalOutput = NULL;
+    globalOffsets = new uint64_t[resultsCount]();
+    for(int pass = 0; pass < 2; pass++){
+        for(uint64_t i=0; i<resultsCount; i++){
+            uint64_t start = i * chunk;
+            uint64_t length = start + chunk > big->size ? big->size - start : chunk;
+            myJobScheduler->Schedule(new SharedProbeJob(big, start, length,
+                                                        index, flag, i));
+        }
+        myJobScheduler->Barrier((int) resultsCount);
+        if(pass == 0)
+            globalOutput = allocateJoinOutput(globalOffsets, resultsCount);
+    }
+
+    JoinResult * result = globalOutput;
+    globalOutput = NULL;
+    delete[] globalOffsets;
+
+    deleteHashIndex(index);
+
+    return result;
+}
+
+// Join over a dense key domain [low, high]. The smaller side is indexed by
+// key - low, so probing is a bounds check and one lookup, without hashing
+// or partitioning
+JoinResult * directJoin(Column * A, Column * B, uint64_t low, uint64_t high){
+    Column * small = A->size < B->size ? A : B;
+    Column * big = A->size < B->size ? B : A;
+    bool flag = big == B;
+
+    DirectIndex * index = buildDirectIndex(small, low, high);
+
+    uint64_t chunk = big->size / (4 * SKEW_SPLIT_FACTOR);
+    if(chunk < MIN_PROBE_CHUNK) chunk = MIN_PROBE_CHUNK;
+    uint64_t resultsCount = (big->size + chunk - 1) / chunk;
+    if(resultsCount == 0) resultsCount = 1;
+
+    // The slices are probed twice, first to count and then to write
+    globalOutput = NULL;
+    globalOffsets = new uint64_t[resultsCount]();
+    for(int pass = 0; pass < 2; pass++){
+        for(uint64_t i=0; i<resultsCount; i++){
+            uint64_t start = i * chunk;
+            uint64_t length = start + chunk > big->size ? big->size - start : chunk;
+            myJobScheduler->Schedule(new DirectProbeJob(big, start, length,
+                                                        index, flag, i));
         }
-        // Find the next element in the current bucket
-        rowIdSmall = chainArray[rowIdSmall];
+        myJobScheduler->Barrier((int) resultsCount);
+        if(pass == 0)
+            globalOutput = allocateJoinOutput(globalOffsets, resultsCount);
+    }
+
+    JoinResult * result = globalOutput;
+    globalOutput = NULL;
+    delete[] globalOffsets;
+
+    deleteDirectIndex(index);
+
+    return result;
+}
+
+// Radix join that never produces the pairs of its matches. Every bucket
+// adds its matches straight to its own copy of the requested sums, which
+// are added up once all the buckets are done. 'weights' are those of the
+// tuples of A, as in aggregateProbe
+uint64_t * joinAggregate(Column * A, Column * B,
+                         AggregateSum * requested, uint64_t sumsCount,
+                         uint64_t * weights, bool packed){
+    setRadixPlan(planPartitioning(A->size < B->size ? A->size : B->size));
+
+    orderedA = bucketifyThread(A, &globalHistA, &globalPsumA, packed);
+    orderedB = bucketifyThread(B, &globalHistB, &globalPsumB, packed);
+
+    uint64_t * partial = new uint64_t[numberOfBuckets * sumsCount];
+    for(uint64_t i=0; i<numberOfBuckets * sumsCount; i++)
+        partial[i] = 0;
+
+    int jobs = 0;
+    for(uint64_t i=0; i<numberOfBuckets; i++){
+        if(globalHistA[i] == 0 || globalHistB[i] == 0) continue;
+        myJobScheduler->Schedule(new AggregateJob(i, requested, sumsCount,
+                                                  weights,
+                                                  partial + i * sumsCount));
+        jobs++;
     }
+    myJobScheduler->Barrier(jobs);
+
+    uint64_t * sums = new uint64_t[sumsCount];
+    for(uint64_t j=0; j<sumsCount; j++){
+        sums[j] = 0;
+        for(uint64_t i=0; i<numberOfBuckets; i++)
+            sums[j] += partial[i * sumsCount + j];
+    }
+    delete[] partial;
+
+    deleteColumn(orderedA);
+    delete[] globalHistA;
+    delete[] globalPsumA;
+
+    deleteColumn(orderedB);
+    delete[] globalHistB;
+    delete[] globalPsumB;
 
+    return sums;
 }
 
 // Returns the number of matches between the two given Columns
@@ -1,30 +1,69 @@
 #include "h1.hpp"
 #include "h2.hpp"
 #include "result.hpp"
+#include "direct.hpp"
+#include "aggregate.hpp"
 #include "../threads/jobs.hpp"
 
-Result ** join(Column * A, Column * B);
+// Joins whose smaller side has at most this many tuples skip partitioning:
+// one index is built over the whole small side and shared by all probe jobs
+#define SHARED_JOIN_THRESHOLD 16384
+
+extern uint64_t sharedJoinThreshold;
+
+JoinResult * join(Column * A, Column * B, bool packed);
+JoinResult * sharedJoin(Column * A, Column * B);
+JoinResult * directJoin(Column * A, Column * B, uint64_t low, uint64_t high);
+uint64_t * joinAggregate(Column * A, Column * B,
+                         AggregateSum * requested, uint64_t sumsCount,
+                         uint64_t * weights, bool packed);
+
+// Probes a slice of the bigger side against the index of the smaller one.
+// All kernels produce the same matches, the vector ones just hash and
+// compare several probe keys per iteration
+typedef void (*ProbeKernel)(Column * orderedBig,
+                            uint64_t bucketSizeBig,
+                            uint64_t startIndexBig,
+                            HashIndex * index,
+                            JoinCursor * cursor);
+
+extern ProbeKernel probeKernel;
+extern ProbeKernel packedProbeKernel;
+const char * selectProbeKernel();
+
+void compareScalar(Column * orderedBig, uint64_t bucketSizeBig,
+                   uint64_t startIndexBig, HashIndex * index,
+                   JoinCursor * cursor);
+void compareAVX2(Column * orderedBig, uint64_t bucketSizeBig,
+                 uint64_t startIndexBig, HashIndex * index,
+                 JoinCursor * cursor);
+void compareAVX512(Column * orderedBig, uint64_t bucketSizeBig,
+                   uint64_t startIndexBig, HashIndex * index,
+                   JoinCursor * cursor);
+void comparePackedScalar(Column * orderedBig, uint64_t bucketSizeBig,
+                         uint64_t startIndexBig, HashIndex * index,
+                         JoinCursor * cursor);
+void comparePackedAVX2(Column * orderedBig, uint64_t bucketSizeBig,
+                       uint64_t startIndexBig, HashIndex * index,
+                       JoinCursor * cursor);
+void comparePackedAVX512(Column * orderedBig, uint64_t bucketSizeBig,
+                         uint64_t startIndexBig, HashIndex * index,
+                         JoinCursor * cursor);
 
 void compare(Column * orderedBig,
-            Column * orderedSmall,
             uint64_t bucketSizeBig,
             uint64_t startIndexBig,
-            uint64_t bucketSizeSmall,
-            uint64_t startIndexSmall,
-            uint64_t * bucketArray,
-            uint64_t * chainArray,
-            Result ** result,
-            bool flag);
+            HashIndex * index,
+            JoinCursor * cursor);
 
 void checkEquals(uint64_t rowidA,
                  uint64_t valueA,
-                 int hash_value,
-                 Column * orderedSmall,
-                 uint64_t startIndexSmall,
-                 uint64_t * bucketArray,
-                 uint64_t * chainArray,
-                 Result ** result,
-                 bool flag,
-                 int rowIdBig);
+                 uint64_t hash_value,
+                 HashIndex * index,
+                 JoinCursor * cursor);
+
+// Turns the match counts of the jobs of a join into their offsets in the
+// output and allocates it
+JoinResult * allocateJoinOutput(uint64_t * offsets, uint64_t jobs);
 
 int naiveJoin(Column * A, Column * B);
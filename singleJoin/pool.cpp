@@ -0,0 +1,101 @@
+#include "pool.hpp"
+#include <cstdlib>
+#include <iostream>
+
+// Header in the cache line before every buffer
+typedef struct PoolHeader{
+    uint64_t sizeClass;
+    PoolHeader * next;
+} PoolHeader;
+
+// Shared by all threads, only for the log
+static uint64_t poolRequests = 0;
+static uint64_t poolHits = 0;
+static uint64_t poolResidentBytes = 0;
+
+static inline uint64_t classBytes(uint64_t sizeClass){
+    return ((uint64_t) 1 << sizeClass) * sizeof(uint64_t);
+}
+
+// Free buffers of the calling thread, one list per size class. They go back
+// to the system when the thread exits
+typedef struct ThreadPool{
+    PoolHeader * free[POOL_CLASSES];
+    uint64_t cachedBytes;
+
+    ~ThreadPool(){
+        for(uint64_t k=0; k<POOL_CLASSES; k++){
+            while(free[k] != NULL){
+                PoolHeader * header = free[k];
+                free[k] = header->next;
+                __sync_fetch_and_sub(&poolResidentBytes, classBytes(k));
+                ::free(header);
+            }
+        }
+        cachedBytes = 0;
+    }
+} ThreadPool;
+
+static thread_local ThreadPool pool;
+
+static inline uint64_t * bufferOf(PoolHeader * header){
+    return (uint64_t *) ((char *) header + POOL_ALIGNMENT);
+}
+
+static inline PoolHeader * headerOf(uint64_t * array){
+    return (PoolHeader *) ((char *) array - POOL_ALIGNMENT);
+}
+
+// Returns a buffer for at least 'size' uint64_t. Its contents are whatever
+// the previous user left in it
+uint64_t * poolAlloc(uint64_t size){
+    uint64_t sizeClass = 0;
+    while(((uint64_t) 1 << sizeClass) < size) sizeClass++;
+
+    __sync_fetch_and_add(&poolRequests, 1);
+
+    PoolHeader * header = pool.free[sizeClass];
+    if(header != NULL){
+        pool.free[sizeClass] = header->next;
+        pool.cachedBytes -= classBytes(sizeClass);
+        __sync_fetch_and_add(&poolHits, 1);
+        __sync_fetch_and_sub(&poolResidentBytes, classBytes(sizeClass));
+        return bufferOf(header);
+    }
+
+    void * memory = NULL;
+    if(posix_memalign(&memory, POOL_ALIGNMENT,
+                      POOL_ALIGNMENT + classBytes(sizeClass)) != 0){
+        std::cerr << "Error at memory allocation." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    header = (PoolHeader *) memory;
+    header->sizeClass = sizeClass;
+    return bufferOf(header);
+}
+
+// Gives a buffer back to the pool of the calling thread, which does not
+// have to be the one that allocated it
+void poolFree(uint64_t * array){
+    if(array == NULL) return;
+
+    PoolHeader * header = headerOf(array);
+    uint64_t bytes = classBytes(header->sizeClass);
+    if(pool.cachedBytes + bytes > POOL_THREAD_BYTES){
+        free(header);
+        return;
+    }
+
+    header->next = pool.free[header->sizeClass];
+    pool.free[header->sizeClass] = header;
+    pool.cachedBytes += bytes;
+    __sync_fetch_and_add(&poolResidentBytes, bytes);
+}
+
+void printPoolStats(){
+    uint64_t requests = poolRequests;
+    uint64_t hits = poolHits;
+    std::cerr << "Pool: " << hits << "/" << requests << " hits ("
+              << (requests ? 100.0 * hits / requests : 0.0) << "%), "
+              << poolResidentBytes << " bytes resident" << '\n';
+}
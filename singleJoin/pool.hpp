@@ -0,0 +1,27 @@
+/***************************************************************************************
+Header file : pool.hpp
+Description : Thread-local pool of uint64_t buffers for Result nodes and join
+              scratch space. Buffers are kept in power of two size classes and
+              handed out again without being zeroed, so joins and queries that
+              follow each other reuse the same memory instead of going back to
+              the system allocator.
+****************************************************************************************/
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <stdint.h>
+
+// Buffers are cache line aligned, the line before them holds their class
+#define POOL_ALIGNMENT 64
+// Number of size classes. Class k holds buffers of 2^k uint64_t
+#define POOL_CLASSES 40
+// Most bytes that a single thread keeps cached. Buffers freed beyond that
+// go back to the system
+#define POOL_THREAD_BYTES (32 * 1024 * 1024ULL)
+
+uint64_t * poolAlloc(uint64_t size);
+void poolFree(uint64_t * array);
+
+void printPoolStats();
+
+#endif // POOL_HPP
@@ -5,6 +5,7 @@ Description : Implementation of methods of structs Node and Result,
 ****************************************************************************************/
 
 #include "result.hpp"
+#include "pool.hpp"
 
 #define CHECK_OR_EXIT(value)                                        \
 {                                                                   \
@@ -14,6 +15,40 @@ Description : Implementation of methods of structs Node and Result,
     }                                                               \
 }
 
+JoinResult * newJoinResult(uint64_t size){
+    JoinResult * res = new JoinResult;
+    CHECK_OR_EXIT(res);
+
+    res->rowidA = new uint64_t[size];
+    res->rowidB = new uint64_t[size];
+    res->size = size;
+
+    return res;
+}
+
+void deleteJoinResult(JoinResult * res){
+    if(res == NULL) return;
+    delete[] res->rowidA;
+    delete[] res->rowidB;
+    delete res;
+}
+
+// A flag of 0 means the probed side is A, as with compare(). Without a
+// JoinResult the cursor only counts on from 'offset'
+JoinCursor newJoinCursor(JoinResult * res, bool flag, uint64_t offset){
+    JoinCursor cursor;
+    cursor.pos = offset;
+    if(res == NULL){
+        cursor.big = NULL;
+        cursor.small = NULL;
+        return cursor;
+    }
+
+    cursor.big = flag == 0 ? res->rowidA : res->rowidB;
+    cursor.small = flag == 0 ? res->rowidB : res->rowidA;
+    return cursor;
+}
+
 Result * newResult(){
     Result * res;
 
@@ -111,15 +146,15 @@ Node * newNode(){
 
     temp->count = 0;
     temp->next = NULL;
-    temp->buffer = (uint64_t *) new char[BUFFER_SIZE]; //1024*1024 bytes
+    // Entries are only read up to 'count', so a recycled buffer is not zeroed
+    temp->buffer = poolAlloc(BUFFER_SIZE / sizeof(uint64_t));
     CHECK_OR_EXIT(temp->buffer);
 
-    memset(temp->buffer,0,BUFFER_SIZE);
     return temp;
 }
 
 void deleteNode(Node * node){
-    delete[] node->buffer;
+    poolFree(node->buffer);
     delete node;
 }
 
@@ -31,6 +31,36 @@ typedef struct Result{
     uint64_t totalEntries;
 } Result;
 
+// Output of a join in two contiguous arrays. The i-th match joined the
+// tuple rowidA[i] of A with the tuple rowidB[i] of B
+typedef struct JoinResult{
+    uint64_t * rowidA;
+    uint64_t * rowidB;
+    uint64_t size;
+} JoinResult;
+
+// Where a join job writes its next match. The rowids of the probed side go
+// to 'big' and those of the indexed side to 'small'. While the job is only
+// counting its matches both arrays are NULL and just 'pos' advances
+typedef struct JoinCursor{
+    uint64_t * big;
+    uint64_t * small;
+    uint64_t pos;
+} JoinCursor;
+
+JoinResult * newJoinResult(uint64_t size);
+void deleteJoinResult(JoinResult * res);
+JoinCursor newJoinCursor(JoinResult * res, bool flag, uint64_t offset);
+
+inline void emitMatch(JoinCursor * cursor, uint64_t bigRowid,
+                      uint64_t smallRowid){
+    if(cursor->big != NULL){
+        cursor->big[cursor->pos] = bigRowid;
+        cursor->small[cursor->pos] = smallRowid;
+    }
+    cursor->pos++;
+}
+
 Result * newResult();
 void deleteResult(Result * res);
 bool isEmptyResult(Result * res);
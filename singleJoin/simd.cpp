@@ -0,0 +1,259 @@
+#include "simd.hpp"
+#include <cstring>
+#include <immintrin.h>
+
+bool cpuHasAVX2(){
+    static int hasAVX2 = -1;
+    if(hasAVX2 == -1){
+        __builtin_cpu_init();
+        hasAVX2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return hasAVX2;
+}
+
+// AVX-512 kernels also need the DQ extension for 64-bit multiplication
+bool cpuHasAVX512(){
+    static int hasAVX512 = -1;
+    if(hasAVX512 == -1){
+        __builtin_cpu_init();
+        hasAVX512 = (__builtin_cpu_supports("avx512f") &&
+                     __builtin_cpu_supports("avx512dq")) ? 1 : 0;
+    }
+    return hasAVX512;
+}
+
+void copyLine(uint64_t * dst, const uint64_t * src){
+    memcpy(dst, src, LINE_ENTRIES * sizeof(uint64_t));
+}
+
+// Write the line with non-temporal stores, bypassing the cache so that the
+// scattered output does not evict the input and the other buffers
+__attribute__((target("avx2")))
+void streamLine(uint64_t * dst, const uint64_t * src){
+    __m256i low = _mm256_load_si256((const __m256i *) src);
+    __m256i high = _mm256_load_si256((const __m256i *) (src + 4));
+    _mm256_stream_si256((__m256i *) dst, low);
+    _mm256_stream_si256((__m256i *) (dst + 4), high);
+}
+
+LineFlush selectLineFlush(){
+    return cpuHasAVX2() ? streamLine : copyLine;
+}
+
+// Make streaming stores visible before the partitions are read
+void storeFence(){
+    _mm_sfence();
+}
+
+uint64_t gatherPrefetchDistance = GATHER_PREFETCH_DISTANCE;
+
+// Every read depends on an index, so without the prefetches only a few of
+// them would be in flight at a time
+void gatherScalar(uint64_t * out, const uint64_t * values,
+                  const uint64_t * index, uint64_t length){
+    uint64_t distance = gatherPrefetchDistance;
+    uint64_t i = 0;
+    for(; distance < length - i; i++){
+        __builtin_prefetch(values + index[i + distance]);
+        out[i] = values[index[i]];
+    }
+    for(; i < length; i++)
+        out[i] = values[index[i]];
+}
+
+__attribute__((target("avx2")))
+void gatherAVX2(uint64_t * out, const uint64_t * values,
+                const uint64_t * index, uint64_t length){
+    const long long * base = (const long long *) values;
+    uint64_t distance = gatherPrefetchDistance;
+    uint64_t i = 0;
+    for(; length - i >= 4 && distance <= length - i - 4; i += 4){
+        for(uint64_t p=0; p<4; p++)
+            __builtin_prefetch(values + index[i + distance + p]);
+        __m256i rows = _mm256_loadu_si256((const __m256i *) (index + i));
+        _mm256_storeu_si256((__m256i *) (out + i),
+                            _mm256_i64gather_epi64(base, rows, 8));
+    }
+    for(; i + 4 <= length; i += 4){
+        __m256i rows = _mm256_loadu_si256((const __m256i *) (index + i));
+        _mm256_storeu_si256((__m256i *) (out + i),
+                            _mm256_i64gather_epi64(base, rows, 8));
+    }
+    for(; i < length; i++)
+        out[i] = values[index[i]];
+}
+
+GatherKernel gatherKernel = gatherScalar;
+
+// Picks the gather kernel the CPU supports and returns its name
+const char * selectGatherKernel(){
+    gatherKernel = cpuHasAVX2() ? gatherAVX2 : gatherScalar;
+    return cpuHasAVX2() ? "avx2" : "scalar";
+}
+
+// Every position is written and the output advances by the comparison
+// itself, so the scan has no data dependent branches. The positions are
+// staged in a block with room for that one extra write, since the output
+// of a job has no slack after its last match
+uint64_t filterScalar(const uint64_t * values, uint64_t start,
+                      uint64_t length, uint64_t value, char op,
+                      uint64_t * out){
+    uint64_t block[FILTER_BLOCK + 1];
+    uint64_t total = 0;
+
+    for(uint64_t b=start; b<start+length; b+=FILTER_BLOCK){
+        uint64_t end = b + FILTER_BLOCK < start + length ? b + FILTER_BLOCK
+                                                         : start + length;
+        uint64_t n = 0;
+        if(op == '<'){
+            for(uint64_t i=b; i<end; i++){
+                block[n] = i;
+                n += values[i] < value;
+            }
+        }
+        else if(op == '>'){
+            for(uint64_t i=b; i<end; i++){
+                block[n] = i;
+                n += values[i] > value;
+            }
+        }
+        else{
+            for(uint64_t i=b; i<end; i++){
+                block[n] = i;
+                n += values[i] == value;
+            }
+        }
+
+        if(out != NULL)
+            memcpy(out + total, block, n * sizeof(uint64_t));
+        total += n;
+    }
+
+    return total;
+}
+
+// Lanes of every 4 bit mask moved to the front, and the store masks that
+// keep the first 0 to 4 lanes
+static long long filterLanes[16][4];
+static long long storeMasks[5][4];
+
+static void initFilterLUT(){
+    for(int mask=0; mask<16; mask++){
+        int out = 0;
+        for(int lane=0; lane<4; lane++)
+            if(mask & (1 << lane))
+                filterLanes[mask][out++] = lane;
+        for(; out<4; out++)
+            filterLanes[mask][out] = 0;
+    }
+    for(int n=0; n<=4; n++)
+        for(int lane=0; lane<4; lane++)
+            storeMasks[n][lane] = lane < n ? -1 : 0;
+}
+
+// AVX2 only compares signed 64-bit lanes, so the sign bit of both sides is
+// flipped to order them as unsigned
+__attribute__((target("avx2")))
+static inline int compareLanesAVX2(__m256i lanes, __m256i value, char op){
+    __m256i sign = _mm256_set1_epi64x((long long) 0x8000000000000000ULL);
+    __m256i hits;
+    if(op == '<')
+        hits = _mm256_cmpgt_epi64(_mm256_xor_si256(value, sign),
+                                  _mm256_xor_si256(lanes, sign));
+    else if(op == '>')
+        hits = _mm256_cmpgt_epi64(_mm256_xor_si256(lanes, sign),
+                                  _mm256_xor_si256(value, sign));
+    else
+        hits = _mm256_cmpeq_epi64(lanes, value);
+    return _mm256_movemask_pd(_mm256_castsi256_pd(hits));
+}
+
+__attribute__((target("avx2")))
+uint64_t filterAVX2(const uint64_t * values, uint64_t start,
+                    uint64_t length, uint64_t value, char op,
+                    uint64_t * out){
+    __m256i wanted = _mm256_set1_epi64x((long long) value);
+    uint64_t end = start + length;
+    uint64_t n = 0;
+    uint64_t i = start;
+
+    for(; i + 4 <= end; i += 4){
+        __m256i lanes = _mm256_loadu_si256((const __m256i *) (values + i));
+        int mask = compareLanesAVX2(lanes, wanted, op);
+        int hits = __builtin_popcount(mask);
+        if(out != NULL){
+            __m256i positions = _mm256_add_epi64(_mm256_set1_epi64x((long long) i),
+                                   _mm256_loadu_si256((const __m256i *) filterLanes[mask]));
+            _mm256_maskstore_epi64((long long *) (out + n),
+                                   _mm256_loadu_si256((const __m256i *) storeMasks[hits]),
+                                   positions);
+        }
+        n += hits;
+    }
+
+    return n + filterScalar(values, i, end - i, value, op,
+                            out == NULL ? NULL : out + n);
+}
+
+__attribute__((target("avx512f")))
+uint64_t filterAVX512(const uint64_t * values, uint64_t start,
+                      uint64_t length, uint64_t value, char op,
+                      uint64_t * out){
+    __m512i wanted = _mm512_set1_epi64((long long) value);
+    __m512i lanes = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+    uint64_t end = start + length;
+    uint64_t n = 0;
+    uint64_t i = start;
+
+    for(; i + 8 <= end; i += 8){
+        __m512i chunk = _mm512_loadu_si512(values + i);
+        __mmask8 mask;
+        if(op == '<')
+            mask = _mm512_cmplt_epu64_mask(chunk, wanted);
+        else if(op == '>')
+            mask = _mm512_cmpgt_epu64_mask(chunk, wanted);
+        else
+            mask = _mm512_cmpeq_epu64_mask(chunk, wanted);
+        if(out != NULL){
+            __m512i positions = _mm512_add_epi64(_mm512_set1_epi64((long long) i),
+                                                 lanes);
+            _mm512_mask_compressstoreu_epi64(out + n, mask, positions);
+        }
+        n += __builtin_popcount(mask);
+    }
+
+    return n + filterScalar(values, i, end - i, value, op,
+                            out == NULL ? NULL : out + n);
+}
+
+// Like filterScalar the positions are always written and kept by the result
+// of the comparison, which only moves the output back over earlier ones
+uint64_t refinePositions(const uint64_t * values, const uint64_t * index,
+                         uint64_t * positions, uint64_t count,
+                         uint64_t value, char op){
+    uint64_t n = 0;
+    for(uint64_t i=0; i<count; i++){
+        uint64_t p = positions[i];
+        uint64_t v = index == NULL ? values[p] : values[index[p]];
+        positions[n] = p;
+        n += op == '<' ? v < value : op == '>' ? v > value : v == value;
+    }
+    return n;
+}
+
+FilterKernel filterKernel = filterScalar;
+
+// Picks the widest filter kernel the CPU supports and returns its name
+const char * selectFilterKernel(){
+    initFilterLUT();
+    if(cpuHasAVX512()){
+        filterKernel = filterAVX512;
+        return "avx512";
+    }
+    if(cpuHasAVX2()){
+        filterKernel = filterAVX2;
+        return "avx2";
+    }
+    filterKernel = filterScalar;
+    return "scalar";
+}
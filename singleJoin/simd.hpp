@@ -0,0 +1,72 @@
+/***************************************************************************************
+Header file : simd.hpp
+Description : Runtime CPU feature detection and the vector kernels that are
+              selected with it. Every kernel has a scalar fallback, so the same
+              binary runs on hosts without AVX2.
+****************************************************************************************/
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <stdint.h>
+
+// Number of uint64_t that fit in a cache line
+#define LINE_ENTRIES 8
+
+bool cpuHasAVX2();
+bool cpuHasAVX512();
+
+// Copies a whole cache line from 'src' to the line aligned 'dst'
+typedef void (*LineFlush)(uint64_t * dst, const uint64_t * src);
+void copyLine(uint64_t * dst, const uint64_t * src);
+void streamLine(uint64_t * dst, const uint64_t * src);
+LineFlush selectLineFlush();
+void storeFence();
+
+// How many rows ahead the gathers prefetch what they are going to read
+#define GATHER_PREFETCH_DISTANCE 16
+#define GATHER_PREFETCH_MAX_DISTANCE 4096
+extern uint64_t gatherPrefetchDistance;
+
+// Reads out[i] = values[index[i]] for i < length. 'out' may be 'index'
+// itself, every index is read before its slot is written
+typedef void (*GatherKernel)(uint64_t * out, const uint64_t * values,
+                             const uint64_t * index, uint64_t length);
+void gatherScalar(uint64_t * out, const uint64_t * values,
+                  const uint64_t * index, uint64_t length);
+void gatherAVX2(uint64_t * out, const uint64_t * values,
+                const uint64_t * index, uint64_t length);
+
+extern GatherKernel gatherKernel;
+const char * selectGatherKernel();
+
+// Writes the positions i in [start, start+length) whose values[i] compares
+// to 'value' with 'op' ('<', '>' or '=') to out[0..) and returns how many
+// there are. With a NULL 'out' they are only counted. Nothing is written
+// past the last position
+typedef uint64_t (*FilterKernel)(const uint64_t * values, uint64_t start,
+                                 uint64_t length, uint64_t value, char op,
+                                 uint64_t * out);
+uint64_t filterScalar(const uint64_t * values, uint64_t start,
+                      uint64_t length, uint64_t value, char op,
+                      uint64_t * out);
+uint64_t filterAVX2(const uint64_t * values, uint64_t start,
+                    uint64_t length, uint64_t value, char op,
+                    uint64_t * out);
+uint64_t filterAVX512(const uint64_t * values, uint64_t start,
+                      uint64_t length, uint64_t value, char op,
+                      uint64_t * out);
+
+extern FilterKernel filterKernel;
+const char * selectFilterKernel();
+
+// Rows a filter stages at a time before copying their positions out
+#define FILTER_BLOCK 256
+
+// Keeps the positions[0..count) whose values[index[p]], or values[p] when
+// 'index' is NULL, compare to 'value' with 'op', in order, and returns how
+// many are left. Checks the later terms of a conjunctive filter
+uint64_t refinePositions(const uint64_t * values, const uint64_t * index,
+                         uint64_t * positions, uint64_t count,
+                         uint64_t value, char op);
+
+#endif // SIMD_HPP
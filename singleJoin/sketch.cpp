@@ -0,0 +1,112 @@
+#include "sketch.hpp"
+#include <math.h>
+#include <algorithm>
+
+// Finalizer of MurmurHash3. Every bit of the value reaches the high bits,
+// which pick the register, and the low bits, whose leading zeros are counted
+static inline uint64_t hllHash(uint64_t x){
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+void hllAdd(uint8_t * registers, const uint64_t * values, uint64_t length){
+    for(uint64_t i=0; i<length; i++){
+        uint64_t hash = hllHash(values[i]);
+        uint64_t rest = hash << HLL_BITS | (uint64_t) 1 << (HLL_BITS - 1);
+        uint8_t rank = __builtin_clzll(rest) + 1;
+        uint8_t * reg = &registers[hash >> (64 - HLL_BITS)];
+        if(rank > *reg) *reg = rank;
+    }
+}
+
+void hllMerge(uint8_t * into, const uint8_t * from){
+    for(uint64_t j=0; j<HLL_REGISTERS; j++)
+        if(from[j] > into[j]) into[j] = from[j];
+}
+
+// Small counts, which leave registers empty, are estimated by linear
+// counting instead
+double hllEstimate(const uint8_t * registers){
+    double m = HLL_REGISTERS;
+    double sum = 0;
+    uint64_t empty = 0;
+    for(uint64_t j=0; j<HLL_REGISTERS; j++){
+        sum += ldexp(1.0, -registers[j]);
+        empty += registers[j] == 0;
+    }
+
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if(estimate <= 2.5 * m && empty > 0)
+        estimate = m * log(m / empty);
+    return estimate;
+}
+
+void buildHistogram(const uint64_t * values, uint64_t rows,
+                    Histogram * histogram){
+    uint64_t size = rows < HIST_SAMPLE ? rows : HIST_SAMPLE;
+    histogram->sampled = size;
+    histogram->mcvCount = 0;
+    if(size == 0)
+        return;
+
+    uint64_t * sample = new uint64_t[size];
+    for(uint64_t i=0; i<size; i++)
+        sample[i] = values[i * rows / size];
+    std::sort(sample, sample + size);
+
+    for(uint64_t b=0; b<HIST_BUCKETS; b++)
+        histogram->bounds[b] = sample[b * size / HIST_BUCKETS];
+    histogram->bounds[HIST_BUCKETS] = sample[size - 1];
+
+    // Runs of equal values in the sorted sample, the longest kept in order
+    uint64_t counts[MCV_COUNT];
+    uint64_t kept = 0;
+    for(uint64_t i=0, run; i<size; i+=run){
+        run = 1;
+        while(i + run < size && sample[i + run] == sample[i])
+            run++;
+        if(run < 2 || (kept == MCV_COUNT && run <= counts[kept - 1]))
+            continue;
+
+        uint64_t j = kept < MCV_COUNT ? kept++ : kept - 1;
+        for(; j > 0 && counts[j - 1] < run; j--){
+            counts[j] = counts[j - 1];
+            histogram->mcv[j] = histogram->mcv[j - 1];
+        }
+        counts[j] = run;
+        histogram->mcv[j] = sample[i];
+    }
+    for(uint64_t j=0; j<kept; j++)
+        histogram->mcvFraction[j] = (double) counts[j] / size;
+    histogram->mcvCount = kept;
+
+    delete[] sample;
+}
+
+// Estimated fraction of the rows with values below k. The values of a
+// bucket are taken to be spread evenly over it
+double histogramBelow(const Histogram * histogram, double k){
+    double below = 0;
+    for(uint64_t b=0; b<HIST_BUCKETS; b++){
+        double low = histogram->bounds[b];
+        double high = histogram->bounds[b + 1];
+        if(k > high)
+            below += 1;
+        else if(k > low)
+            below += (k - low) / (high - low + 1);
+    }
+    return below / HIST_BUCKETS;
+}
+
+// Estimated fraction of the rows with the value k when it is one of the
+// most common values, -1 otherwise
+double histogramMCV(const Histogram * histogram, double k){
+    for(uint64_t j=0; j<histogram->mcvCount; j++)
+        if(histogram->mcv[j] == k)
+            return histogram->mcvFraction[j];
+    return -1;
+}
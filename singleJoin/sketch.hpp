@@ -0,0 +1,38 @@
+#include <stdint.h>
+
+#ifndef SKETCH_HPP
+#define SKETCH_HPP
+
+// HyperLogLog sketch of the distinct values of a column: 2^HLL_BITS one
+// byte registers, 4 KB, for a standard error of about 1.6%. Sketches of
+// parts of a column merge into the sketch of the whole column
+#define HLL_BITS 12
+#define HLL_REGISTERS (1 << HLL_BITS)
+
+void hllAdd(uint8_t * registers, const uint64_t * values, uint64_t length);
+void hllMerge(uint8_t * into, const uint8_t * from);
+double hllEstimate(const uint8_t * registers);
+
+// Equi-depth histogram of a column, built from a sample of up to HIST_SAMPLE
+// evenly spaced rows: about 1/HIST_BUCKETS of the rows have values in each
+// bucket [bounds[b], bounds[b+1]]. With it the up to MCV_COUNT values that
+// are the most common in the sample, at least twice, and the fraction of
+// the rows estimated to hold each. Without any rows 'sampled' is 0
+#define HIST_SAMPLE 16384
+#define HIST_BUCKETS 64
+#define MCV_COUNT 16
+
+typedef struct Histogram{
+    uint64_t sampled;
+    uint64_t bounds[HIST_BUCKETS + 1];
+    uint64_t mcvCount;
+    uint64_t mcv[MCV_COUNT];
+    double mcvFraction[MCV_COUNT];
+} Histogram;
+
+void buildHistogram(const uint64_t * values, uint64_t rows,
+                    Histogram * histogram);
+double histogramBelow(const Histogram * histogram, double k);
+double histogramMCV(const Histogram * histogram, double k);
+
+#endif // SKETCH_HPP
@@ -0,0 +1,197 @@
+#include "sortMerge.hpp"
+#include "join.hpp"
+#include "pool.hpp"
+#include "../threads/scheduler.hpp"
+
+extern JobScheduler * myJobScheduler;
+extern JoinResult * globalOutput;
+extern uint64_t * globalOffsets;
+
+// Estimate the fraction of adjacent pairs that are in order by looking at
+// SORTED_SAMPLE pairs spread over the whole column
+double sortedFraction(Column * column){
+    if(column->size < 2) return 1;
+
+    uint64_t pairs = column->size - 1;
+    uint64_t step = pairs / SORTED_SAMPLE;
+    if(step == 0) step = 1;
+
+    uint64_t sampled = 0;
+    uint64_t ordered = 0;
+    for(uint64_t i=0; i<pairs; i+=step){
+        if(column->value[i] <= column->value[i+1]) ordered++;
+        sampled++;
+    }
+    return (double) ordered / sampled;
+}
+
+bool isSortedRun(Column * column, uint64_t start, uint64_t length){
+    for(uint64_t i=start+1; i<start+length; i++)
+        if(column->value[i-1] > column->value[i]) return false;
+    return true;
+}
+
+// LSD radix sort of the tuples [start, start+length) of 'in' into the same
+// positions of 'out'. Only as many passes as the largest value needs are made
+void radixSortRun(Column * in, Column * out, uint64_t start, uint64_t length){
+    if(isSortedRun(in, start, length)){
+        memcpy(out->value + start, in->value + start, length * sizeof(uint64_t));
+        memcpy(out->rowid + start, in->rowid + start, length * sizeof(uint64_t));
+        return;
+    }
+
+    uint64_t max = 0;
+    for(uint64_t i=start; i<start+length; i++)
+        if(in->value[i] > max) max = in->value[i];
+
+    uint64_t passes = 0;
+    while(passes * SORT_RADIX_BITS < 64 && (max >> (passes * SORT_RADIX_BITS)) != 0)
+        passes++;
+
+    // Ping-pong between 'out' and a temporary run so that the last pass
+    // always writes to 'out'
+    uint64_t * tempValue = poolAlloc(length);
+    uint64_t * tempRowid = poolAlloc(length);
+    uint64_t * srcValue = in->value + start;
+    uint64_t * srcRowid = in->rowid + start;
+    uint64_t * dstValue = passes % 2 ? out->value + start : tempValue;
+    uint64_t * dstRowid = passes % 2 ? out->rowid + start : tempRowid;
+
+    uint64_t buckets = (uint64_t) 1 << SORT_RADIX_BITS;
+    uint64_t mask = buckets - 1;
+    uint64_t * offsets = new uint64_t[buckets];
+
+    for(uint64_t pass=0; pass<passes; pass++){
+        uint64_t shift = pass * SORT_RADIX_BITS;
+
+        for(uint64_t i=0; i<buckets; i++)
+            offsets[i] = 0;
+        for(uint64_t i=0; i<length; i++)
+            offsets[(srcValue[i] >> shift) & mask]++;
+
+        uint64_t sum = 0;
+        for(uint64_t i=0; i<buckets; i++){
+            uint64_t count = offsets[i];
+            offsets[i] = sum;
+            sum += count;
+        }
+
+        for(uint64_t i=0; i<length; i++){
+            uint64_t pos = offsets[(srcValue[i] >> shift) & mask]++;
+            dstValue[pos] = srcValue[i];
+            dstRowid[pos] = srcRowid[i];
+        }
+
+        srcValue = dstValue;
+        srcRowid = dstRowid;
+        if(dstValue == tempValue){
+            dstValue = out->value + start;
+            dstRowid = out->rowid + start;
+        }
+        else{
+            dstValue = tempValue;
+            dstRowid = tempRowid;
+        }
+    }
+
+    // A run of equal values needs no pass at all
+    if(passes == 0){
+        memcpy(out->value + start, in->value + start, length * sizeof(uint64_t));
+        memcpy(out->rowid + start, in->rowid + start, length * sizeof(uint64_t));
+    }
+
+    delete[] offsets;
+    poolFree(tempValue);
+    poolFree(tempRowid);
+}
+
+// Merge join two sorted runs. A is the 'big' side of the cursor, so its
+// rowids go to rowidA of the output as with join()
+void mergeRuns(Column * A, uint64_t startA, uint64_t lengthA,
+               Column * B, uint64_t startB, uint64_t lengthB,
+               JoinCursor * cursor){
+    uint64_t a = startA, endA = startA + lengthA;
+    uint64_t b = startB, endB = startB + lengthB;
+
+    while(a < endA && b < endB){
+        uint64_t valueA = A->value[a];
+        uint64_t valueB = B->value[b];
+
+        if(valueA < valueB){
+            a++;
+        }
+        else if(valueA > valueB){
+            b++;
+        }
+        else{
+            // Find the group of equal values on both sides and emit their
+            // cross product
+            uint64_t groupA = a;
+            while(groupA < endA && A->value[groupA] == valueA) groupA++;
+            uint64_t groupB = b;
+            while(groupB < endB && B->value[groupB] == valueB) groupB++;
+
+            if(cursor->big == NULL){
+                cursor->pos += (groupA - a) * (groupB - b);
+            }
+            else{
+                for(uint64_t i=a; i<groupA; i++)
+                    for(uint64_t j=b; j<groupB; j++)
+                        emitMatch(cursor, A->rowid[i], B->rowid[j]);
+            }
+            a = groupA;
+            b = groupB;
+        }
+    }
+}
+
+JoinResult * sortMergeJoin(Column * A, Column * B){
+    Column * sortedA = newAlignedColumn(A->size);
+    Column * sortedB = newAlignedColumn(B->size);
+
+    uint64_t runA = A->size / SORT_RUNS;
+    uint64_t runB = B->size / SORT_RUNS;
+    uint64_t startA[SORT_RUNS], lengthA[SORT_RUNS];
+    uint64_t startB[SORT_RUNS], lengthB[SORT_RUNS];
+
+    // The last run may take the extra tuples
+    for(uint64_t i=0; i<SORT_RUNS; i++){
+        startA[i] = i * runA;
+        lengthA[i] = i == SORT_RUNS - 1 ? A->size - startA[i] : runA;
+        startB[i] = i * runB;
+        lengthB[i] = i == SORT_RUNS - 1 ? B->size - startB[i] : runB;
+    }
+
+    for(uint64_t i=0; i<SORT_RUNS; i++){
+        myJobScheduler->Schedule(new SortJob(A, sortedA, startA[i], lengthA[i]));
+        myJobScheduler->Schedule(new SortJob(B, sortedB, startB[i], lengthB[i]));
+    }
+    myJobScheduler->Barrier(2 * SORT_RUNS);
+
+    // Every run of A against every run of B, each with its own slice of the
+    // output. The first pass counts the slices, the second fills them
+    uint64_t resultsCount = SORT_RUNS * SORT_RUNS;
+    globalOutput = NULL;
+    globalOffsets = new uint64_t[resultsCount]();
+    for(int pass = 0; pass < 2; pass++){
+        for(uint64_t i=0; i<SORT_RUNS; i++){
+            for(uint64_t j=0; j<SORT_RUNS; j++){
+                myJobScheduler->Schedule(new MergeJob(sortedA, startA[i], lengthA[i],
+                                                      sortedB, startB[j], lengthB[j],
+                                                      i * SORT_RUNS + j));
+            }
+        }
+        myJobScheduler->Barrier((int) resultsCount);
+        if(pass == 0)
+            globalOutput = allocateJoinOutput(globalOffsets, resultsCount);
+    }
+
+    JoinResult * result = globalOutput;
+    globalOutput = NULL;
+    delete[] globalOffsets;
+
+    deleteColumn(sortedA);
+    deleteColumn(sortedB);
+
+    return result;
+}
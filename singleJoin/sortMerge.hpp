@@ -0,0 +1,29 @@
+/***************************************************************************************
+Header file : sortMerge.hpp
+Description : Parallel sort-merge join. Both inputs are cut into one run per
+              thread, every run is radix sorted on its own and then every run
+              of A is merge joined with every run of B (MPSM style), so no
+              global sort or partitioning is needed.
+****************************************************************************************/
+#ifndef SORT_MERGE_HPP
+#define SORT_MERGE_HPP
+
+#include "structs.hpp"
+#include "result.hpp"
+
+// Number of runs each input is split into
+#define SORT_RUNS 4
+// Bits sorted by every pass of the LSD radix sort
+#define SORT_RADIX_BITS 8
+// Number of adjacent pairs sampled to estimate how sorted a column is
+#define SORTED_SAMPLE 4096
+
+double sortedFraction(Column * column);
+bool isSortedRun(Column * column, uint64_t start, uint64_t length);
+void radixSortRun(Column * in, Column * out, uint64_t start, uint64_t length);
+void mergeRuns(Column * A, uint64_t startA, uint64_t lengthA,
+               Column * B, uint64_t startB, uint64_t lengthB,
+               JoinCursor * cursor);
+JoinResult * sortMergeJoin(Column * A, Column * B);
+
+#endif // SORT_MERGE_HPP
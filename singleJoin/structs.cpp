@@ -1,11 +1,25 @@
 #include "structs.hpp"
 
-Column * newColumn(uint64_t size){
-    Column * rel = new Column;
-    rel->rowid = new uint64_t[size];
-    rel->value = new uint64_t[size];
+// Column arrays start on a cache line so that partitioning can write whole
+// lines of them with streaming stores
+#define COLUMN_ALIGNMENT 64
 
-    rel->size = size;
+uint64_t * newAlignedArray(uint64_t size){
+    void * array = NULL;
+    if(posix_memalign(&array, COLUMN_ALIGNMENT,
+                      (size ? size : 1) * sizeof(uint64_t)) != 0){
+        std::cerr << "Error at memory allocation." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return (uint64_t *) array;
+}
+
+void deleteAlignedArray(uint64_t * array){
+    free(array);
+}
+
+Column * newColumn(uint64_t size){
+    Column * rel = newAlignedColumn(size);
 
     // Initialize with 0 (maybe not needed)
      for(uint64_t i = 0; i<size; i++){
@@ -16,13 +30,29 @@ Column * newColumn(uint64_t size){
     return rel;
 }
 
-// Create and return a Column with serial values
-Column * randomColumn(uint64_t size){
+// Create a Column with cache line aligned arrays, left uninitialised
+Column * newAlignedColumn(uint64_t size){
     Column * rel = new Column;
-    rel->rowid = new uint64_t[size];
-    rel->value = new uint64_t[size];
+    rel->rowid = newAlignedArray(size);
+    rel->value = newAlignedArray(size);
 
     rel->size = size;
+    return rel;
+}
+
+// Create a packed Column, left uninitialised
+Column * newPackedColumn(uint64_t size){
+    Column * rel = new Column;
+    rel->rowid = NULL;
+    rel->value = newAlignedArray(size);
+
+    rel->size = size;
+    return rel;
+}
+
+// Create and return a Column with serial values
+Column * randomColumn(uint64_t size){
+    Column * rel = newAlignedColumn(size);
     for(uint64_t i = 0; i<size; i++){
         rel->rowid[i] = i+1;
         rel->value[i] = rand()%2000;
@@ -32,11 +62,7 @@ Column * randomColumn(uint64_t size){
 
 // Create and return a Column with serial values
 Column * serialColumn(uint64_t size){
-    Column * rel = new Column;
-    rel->rowid = new uint64_t[size];
-    rel->value = new uint64_t[size];
-
-    rel->size = size;
+    Column * rel = newAlignedColumn(size);
     for(uint64_t i = 0; i<size; i++){
         rel->rowid[i] = i+1;
         rel->value[i] = i+1;
@@ -46,11 +72,7 @@ Column * serialColumn(uint64_t size){
 
 // Create and return a Column with odd values
 Column * oddColumn(uint64_t size){
-    Column * rel = new Column;
-    rel->rowid = new uint64_t[size];
-    rel->value = new uint64_t[size];
-
-    rel->size = size;
+    Column * rel = newAlignedColumn(size);
     uint64_t value = 1;
     for(uint64_t i = 0; i<size; i++){
         rel->rowid[i] = i+1;
@@ -62,11 +84,7 @@ Column * oddColumn(uint64_t size){
 
 // Create and return a Column with even values
 Column * evenColumn(uint64_t size){
-    Column * rel = new Column;
-    rel->rowid = new uint64_t[size];
-    rel->value = new uint64_t[size];
-
-    rel->size = size;
+    Column * rel = newAlignedColumn(size);
     uint64_t value = 0;
     for(uint64_t i = 0; i<size; i++){
         rel->rowid[i] = i+1;
@@ -78,8 +96,8 @@ Column * evenColumn(uint64_t size){
 
 
 void deleteColumn(Column * rel){
-    delete[] rel->rowid;
-    delete[] rel->value;
+    deleteAlignedArray(rel->rowid);
+    deleteAlignedArray(rel->value);
     delete rel;
 }
 
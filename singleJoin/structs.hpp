@@ -13,7 +13,31 @@ struct Column{
     uint64_t size;
 };
 
+// A radix join whose keys and rowids all fit in 32 bits partitions packed
+// tuples: one word per tuple with the key in the low half, so h1 sees the
+// same bits. A packed Column keeps them in 'value' and has no rowid array
+#define PACKED_LIMIT ((uint64_t) 1 << 32)
+#define PACKED_KEY_MASK (PACKED_LIMIT - 1)
+
+inline uint64_t packTuple(uint64_t key, uint64_t rowid){
+    return key | rowid << 32;
+}
+inline uint64_t packedKey(uint64_t tuple){
+    return tuple & PACKED_KEY_MASK;
+}
+inline uint64_t packedRowid(uint64_t tuple){
+    return tuple >> 32;
+}
+inline bool isPacked(Column * rel){
+    return rel->rowid == NULL;
+}
+
+uint64_t * newAlignedArray(uint64_t size);
+void deleteAlignedArray(uint64_t * array);
+
 Column * newColumn(uint64_t size);
+Column * newAlignedColumn(uint64_t size);
+Column * newPackedColumn(uint64_t size);
 Column * randomColumn(uint64_t size);
 Column * serialColumn(uint64_t size);
 Column * oddColumn(uint64_t size);
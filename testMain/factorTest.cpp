@@ -0,0 +1,183 @@
+#include <iostream>
+#include "../join/intermediate.hpp"
+#include "../join/stats.hpp"
+#include "../singleJoin/aggregate.hpp"
+#include "../threads/scheduler.hpp"
+
+// The IR objects refer to the globals of main
+Relation * r;
+uint64_t relationsSize;
+Stats ** stats;
+JobScheduler * myJobScheduler;
+
+// Rowids of the three relations of the IR below, once it is flattened
+uint64_t flatRel0[6] = {10, 10, 12, 13, 13, 13};
+uint64_t flatRel1[6] = {20, 20, 22, 23, 23, 23};
+uint64_t flatRel2[6] = {100, 101, 102, 103, 104, 105};
+
+// Value of every rowid in the sums
+uint64_t values[106];
+
+int failures = 0;
+
+void check(bool condition, const char * what){
+    std::cout << (condition ? "OK      " : "FAILED  ") << what << std::endl;
+    if(!condition) failures++;
+}
+
+// Four rows of relations 0 and 1, factorized with relation 2. Row 1 has no
+// match and the matches of the other rows arrive out of order, so the
+// groups are 0 -> {100, 101}, 2 -> {102} and 3 -> {103, 104, 105}
+Intermediate * factorizedIR(){
+    Intermediate * IR = newIntermediate(3);
+    uint64_t * rel0 = new uint64_t[4];
+    uint64_t * rel1 = new uint64_t[4];
+    for(uint64_t i=0; i<4; i++){
+        rel0[i] = 10 + i;
+        rel1[i] = 20 + i;
+    }
+    setIntermediateColumn(IR, 0, rel0);
+    setIntermediateColumn(IR, 1, rel1);
+    IR->length = 4;
+
+    uint64_t * rows = new uint64_t[6];
+    uint64_t * rowids = new uint64_t[6];
+    uint64_t matchRows[6] = {3, 0, 2, 3, 0, 3};
+    uint64_t matchRowids[6] = {103, 100, 102, 104, 101, 105};
+    for(uint64_t k=0; k<6; k++){
+        rows[k] = matchRows[k];
+        rowids[k] = matchRowids[k];
+    }
+    factorizeIntermediate(IR, 2, rows, rowids, 6);
+    return IR;
+}
+
+// Sum of 'values' over the rows of 'relation' that the IR stands for
+uint64_t weightedSum(Intermediate * IR, uint64_t relation){
+    uint64_t * prefix = factorPrefixSums(IR, values);
+    uint64_t sum = 0;
+    for(uint64_t i=0; i<IR->length; i++)
+        sum += intermediateRowSum(IR, relation, values, prefix, i);
+    delete[] prefix;
+    return sum;
+}
+
+// Sum of 'values' over the flattened rows of 'relation' that are kept
+uint64_t flatSum(uint64_t * flat, bool * kept){
+    uint64_t sum = 0;
+    for(uint64_t i=0; i<6; i++)
+        if(kept[i]) sum += values[flat[i]];
+    return sum;
+}
+
+bool flattenedAs(Intermediate * IR, bool * kept){
+    uint64_t * flat[3] = {flatRel0, flatRel1, flatRel2};
+    uint64_t i = 0;
+    for(uint64_t k=0; k<6; k++){
+        if(!kept[k]) continue;
+        for(uint64_t rel=0; rel<3; rel++)
+            if(i >= IR->length || IR->results[rel][i] != flat[rel][k])
+                return false;
+        i++;
+    }
+    return i == IR->length && !isFactorized(IR);
+}
+
+int main(void){
+    for(uint64_t t=0; t<106; t++)
+        values[t] = 3 * t + 1;
+    bool all[6] = {true, true, true, true, true, true};
+
+    // Groups and weights
+    Intermediate * IR = factorizedIR();
+    check(IR->length == 3 && IR->factorRel == 2 && IR->factorSize == 6,
+          "factorize keeps the rows with matches");
+    check(IR->results[0][0] == 10 && IR->results[0][1] == 12 &&
+          IR->results[0][2] == 13 && IR->results[1][2] == 23,
+          "factorize drops the rows without matches");
+    check(factorWeight(IR, 0) == 2 && factorWeight(IR, 1) == 1 &&
+          factorWeight(IR, 2) == 3, "factor weights are the group sizes");
+
+    // Weighted sums against the sums of the flattened rows
+    check(weightedSum(IR, 0) == flatSum(flatRel0, all) &&
+          weightedSum(IR, 1) == flatSum(flatRel1, all) &&
+          weightedSum(IR, 2) == flatSum(flatRel2, all),
+          "intermediateRowSum matches the flattened sums");
+    check(sumIntermediateValues(IR, 0, values) == flatSum(flatRel0, all) &&
+          sumIntermediateValues(IR, 1, values) == flatSum(flatRel1, all),
+          "sumIntermediateValues weighs the rows by their groups");
+
+    // A join of the IR on (rowid of relation 0) % 2 with four tuples of B,
+    // summed through aggregateProbe and over the flattened rows
+    uint64_t keysB[4] = {0, 1, 1, 5};
+    Column * B = newColumn(4);
+    for(uint64_t t=0; t<4; t++){
+        B->rowid[t] = t;
+        B->value[t] = keysB[t];
+    }
+    Column * A = newColumn(IR->length);
+    uint64_t * grouped = new uint64_t[IR->length];
+    uint64_t * prefix = factorPrefixSums(IR, values);
+    for(uint64_t i=0; i<IR->length; i++){
+        A->rowid[i] = i;
+        A->value[i] = IR->results[0][i] % 2;
+        grouped[i] = intermediateRowSum(IR, 2, values, prefix, i);
+    }
+    delete[] prefix;
+
+    AggregateSum requested[2];
+    requested[0].side = 0;
+    requested[0].values = grouped;
+    requested[0].rowids = NULL;
+    requested[1].side = 1;
+    requested[1].values = values;
+    requested[1].rowids = NULL;
+    uint64_t sums[2] = {0, 0};
+    HashIndex * index = buildHashIndex(B, B->size, 0);
+    aggregateProbe(A, A->size, 0, index, 0, requested, 2, IR->factorCount, sums);
+
+    uint64_t expected[2] = {0, 0};
+    for(uint64_t k=0; k<6; k++)
+        for(uint64_t t=0; t<4; t++)
+            if(flatRel0[k] % 2 == keysB[t]){
+                expected[0] += values[flatRel2[k]];
+                expected[1] += values[t];
+            }
+    check(sums[0] == expected[0] && sums[1] == expected[1],
+          "aggregateProbe weighs the matches by factorCount");
+    deleteHashIndex(index);
+    deleteColumn(A);
+    deleteColumn(B);
+    delete[] grouped;
+
+    flattenIntermediate(IR);
+    check(flattenedAs(IR, all), "flatten expands every group");
+    deleteIntermediate(IR);
+
+    // A selection over the factor keeps the groups of rows 0 and 3
+    IR = factorizedIR();
+    uint64_t * rows = new uint64_t[2];
+    rows[0] = 0;
+    rows[1] = 2;
+    selectIntermediate(IR, rows, 2);
+    bool selected[6] = {true, true, false, true, true, true};
+    check(IR->selection != NULL && factorWeight(IR, 0) == 2 &&
+          factorWeight(IR, 1) == 3, "factor weights follow the selection");
+    check(weightedSum(IR, 0) == flatSum(flatRel0, selected) &&
+          weightedSum(IR, 1) == flatSum(flatRel1, selected) &&
+          weightedSum(IR, 2) == flatSum(flatRel2, selected),
+          "intermediateRowSum matches the flattened sums under a selection");
+    check(sumIntermediateValues(IR, 0, values) == flatSum(flatRel0, selected),
+          "sumIntermediateValues follows the selection");
+
+    flattenIntermediate(IR);
+    check(IR->selection == NULL && flattenedAs(IR, selected),
+          "flatten applies the selection");
+    check(weightedSum(IR, 2) == flatSum(flatRel2, selected),
+          "flattened sums are unchanged");
+    deleteIntermediate(IR);
+
+    if(failures == 0)
+        std::cout << "All working well." << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+#include <iostream>
+#include <sys/time.h>
+#include "../singleJoin/join.hpp"
+#include "../join/stats.hpp"
+#include "../threads/scheduler.hpp"
+
+// The join objects refer to the globals of main
+Relation * r;
+uint64_t relationsSize;
+Stats ** stats;
+JobScheduler * myJobScheduler;
+
+// Compares the build and probe throughput of the prime sized chained index
+// (bucketify2) with the power of two HashIndex, on buckets of the size the
+// radix partitioning aims for. The HashIndex is probed both by the scalar
+// kernel and by the one selectProbeKernel picks, which JoinJob runs
+
+#define BUCKETS 64
+#define BUILD_SIZE 8192
+#define PROBE_SIZE (4 * BUILD_SIZE)
+
+double now(){
+    struct timeval te;
+    gettimeofday(&te, 0);
+    return te.tv_sec + te.tv_usec / 1000000.0;
+}
+
+// The probe loop of the chained index, as compare/checkEquals used to do it
+uint64_t probeChained(Column * build, Column * probe,
+                      uint64_t * bucketArray, uint64_t * chainArray){
+    uint64_t matches = 0;
+    uint64_t prime = nextPrime(build->size);
+    for(uint64_t i=0; i<probe->size; i++){
+        uint64_t value = probe->value[i];
+        uint64_t pos = bucketArray[h2Prime(value, prime)];
+        while(pos != (uint64_t) -1){
+            if(build->value[pos] == value) matches++;
+            pos = chainArray[pos];
+        }
+    }
+    return matches;
+}
+
+// The counting pass of a JoinJob, which sizes its share of the output
+uint64_t probeHashIndex(Column * probe, HashIndex * index, ProbeKernel kernel){
+    JoinCursor cursor = newJoinCursor(NULL, false, 0);
+    kernel(probe, probe->size, 0, index, &cursor);
+    return cursor.pos;
+}
+
+// Keys share their low 8 bits, like the tuples of one h1 bucket do
+Column * bucketColumn(uint64_t size, uint64_t domain){
+    Column * column = newColumn(size);
+    for(uint64_t i=0; i<size; i++){
+        column->rowid[i] = i;
+        column->value[i] = ((uint64_t) (rand() % domain) << 8) | 0x2a;
+    }
+    return column;
+}
+
+void bench(const char * name, uint64_t domain, const char * kernelName){
+    Column * build[BUCKETS];
+    Column * probe[BUCKETS];
+    for(uint64_t b=0; b<BUCKETS; b++){
+        build[b] = bucketColumn(BUILD_SIZE, domain);
+        probe[b] = bucketColumn(PROBE_SIZE, domain);
+    }
+
+    uint64_t chainedMatches = 0;
+    double chainedBuild = 0, chainedProbe = 0;
+    for(uint64_t b=0; b<BUCKETS; b++){
+        uint64_t * bucketArray;
+        uint64_t * chainArray;
+        double start = now();
+        bucketify2(build[b], BUILD_SIZE, 0, &bucketArray, &chainArray);
+        chainedBuild += now() - start;
+        start = now();
+        chainedMatches += probeChained(build[b], probe[b], bucketArray, chainArray);
+        chainedProbe += now() - start;
+        delete[] bucketArray;
+        delete[] chainArray;
+    }
+
+    uint64_t indexMatches = 0, kernelMatches = 0;
+    double indexBuild = 0, indexProbe = 0, kernelProbe = 0;
+    for(uint64_t b=0; b<BUCKETS; b++){
+        double start = now();
+        HashIndex * index = buildHashIndex(build[b], BUILD_SIZE, 0);
+        indexBuild += now() - start;
+        start = now();
+        indexMatches += probeHashIndex(probe[b], index, compareScalar);
+        indexProbe += now() - start;
+        start = now();
+        kernelMatches += probeHashIndex(probe[b], index, probeKernel);
+        kernelProbe += now() - start;
+        deleteHashIndex(index);
+    }
+
+    double probed = (double) BUCKETS * PROBE_SIZE / 1000000;
+    double built = (double) BUCKETS * BUILD_SIZE / 1000000;
+    std::cout << name << " (" << chainedMatches << "/" << indexMatches
+              << "/" << kernelMatches << " matches)" << std::endl;
+    std::cout << "\tchained:    build " << built / chainedBuild
+              << " Mtuples/s, probe " << probed / chainedProbe
+              << " Mtuples/s" << std::endl;
+    std::cout << "\tpower of 2: build " << built / indexBuild
+              << " Mtuples/s, probe " << probed / indexProbe
+              << " Mtuples/s" << std::endl;
+    std::cout << "\tpower of 2 (" << kernelName << "): probe "
+              << probed / kernelProbe << " Mtuples/s" << std::endl;
+
+    for(uint64_t b=0; b<BUCKETS; b++){
+        deleteColumn(build[b]);
+        deleteColumn(probe[b]);
+    }
+}
+
+int main(void){
+    srand(42);
+    const char * kernelName = selectProbeKernel();
+    bench("Unique keys", 1 << 30, kernelName);
+    bench("Dense keys", BUILD_SIZE, kernelName);
+    bench("Duplicate heavy keys", 64, kernelName);
+    return 0;
+}
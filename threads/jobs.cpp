@@ -1,9 +1,14 @@
 #include "jobs.hpp"
 #include <iostream>
+#include <vector>
+#include <algorithm>
 
 #include "../singleJoin/join.hpp"
+#include "../singleJoin/sortMerge.hpp"
 
 #include "scheduler.hpp"
+#include "../singleJoin/simd.hpp"
+#include "../singleJoin/pool.hpp"
 
 //global
 uint64_t * histograms[4];
@@ -15,7 +20,11 @@ extern uint64_t * globalPsumA;
 extern uint64_t * globalHistB;
 extern uint64_t * globalPsumB;
 
-extern Result *** globalResults;
+extern JoinResult * globalOutput;
+extern uint64_t * globalOffsets;
+// h2 index of every bucket, built once and used by both passes of the join.
+// The index of a heavy bucket is shared by all its probe jobs
+HashIndex ** globalIndexes;
 
 extern Column * orderedA;
 extern Column * orderedB;
@@ -23,13 +32,21 @@ extern Column * orderedB;
 pthread_mutex_t memcpy_mtx;
 
 // Takes A as input and returns A'
+// Partitions according to the global 'radixPlan'. The first pass scatters
+// on the high bits of the radix and, if the plan has a second pass, every
+// resulting partition is refined on the low bits by its own job. With
+// 'packed' the first pass packs every tuple and A' is a packed Column
 Column * bucketifyThread(Column * rel,
                   uint64_t ** histogram,
-                  uint64_t ** startingPositions){
+                  uint64_t ** startingPositions,
+                  bool packed){
 
                       
     pthread_mutex_init(&memcpy_mtx,NULL);
 
+    uint64_t passBuckets = (uint64_t) 1 << radixPlan.bitsPass1;
+    uint64_t shift = radixPlan.bitsPass2;
+
     // Calculate histograms
     uint64_t * startA = rel->value;
 
@@ -40,38 +57,38 @@ Column * bucketifyThread(Column * rel,
     uint64_t i;
 
     for (i = 0; i < 4; i++) {
-        histograms[i] = new uint64_t[numberOfBuckets];
-        for(uint64_t j=0; j<numberOfBuckets; j++){
+        histograms[i] = new uint64_t[passBuckets];
+        for(uint64_t j=0; j<passBuckets; j++){
             histograms[i][j] = 0;
         }
     }
 
     for (i = 0; i < 3; i++) {
-        myJobScheduler->Schedule(new HistogramJob(startA,length,&histograms[i]));
+        myJobScheduler->Schedule(new HistogramJob(startA,length,&histograms[i],
+                                                  shift,passBuckets));
         startA += length;
     }
     //last thread may take extra length
-    myJobScheduler->Schedule(new HistogramJob(startA,length+lastExtra,&histograms[i]));
+    myJobScheduler->Schedule(new HistogramJob(startA,length+lastExtra,&histograms[i],
+                                              shift,passBuckets));
 
     //std::cerr << "Before barrier 1" << '\n';
     myJobScheduler->Barrier(4);
     //std::cerr << "After barrier 1" << '\n';
 
     //construct the whole histogram
-    uint64_t * wholeHistogram = new uint64_t[numberOfBuckets];
+    uint64_t * wholeHistogram = new uint64_t[passBuckets];
 
-    for(uint64_t i=0; i<numberOfBuckets; i++){
+    for(uint64_t i=0; i<passBuckets; i++){
         wholeHistogram[i] = 0;
         for (int j = 0; j < 4; j++) {
             wholeHistogram[i] += histograms[j][i];
         }
     }
 
-    *histogram = wholeHistogram;
-
     //calculate psums for each next thread
     for (uint64_t i = 0; i < 4; i++) {
-        psums[i] = new uint64_t[numberOfBuckets];
+        psums[i] = new uint64_t[passBuckets];
     }
 
     //for first psum
@@ -81,26 +98,28 @@ Column * bucketifyThread(Column * rel,
     }
 
     //for rest psums
-    for(uint64_t i=1; i<numberOfBuckets; i++){
+    for(uint64_t i=1; i<passBuckets; i++){
         psums[0][i] = psums[3][i-1] + histograms[3][i-1];
         for(uint64_t j = 1; j < 4; j++){
             psums[j][i] = psums[j-1][i] + histograms[j-1][i];
         }
     }
 
-    // Create the final ordered Column
-    Column * threadOrdered = newColumn(rel->size);
+    // Create the final ordered Column. Every position is written by the
+    // partition jobs, so it needs no initialisation
+    Column * threadOrdered = packed ? newPackedColumn(rel->size)
+                                    : newAlignedColumn(rel->size);
 
     // Create partition jobs
     uint64_t start = 0;
     for (i = 0; i < 3; i++) {
         myJobScheduler->Schedule(new PartitionJob(rel,start,length,psums[i],
-                                        numberOfBuckets,threadOrdered));
+                                        passBuckets,shift,threadOrdered));
         start += length;
     }
     //last thread may take extra length
     myJobScheduler->Schedule(new PartitionJob(rel,start,length+lastExtra,psums[i],
-                                    numberOfBuckets,threadOrdered));
+                                    passBuckets,shift,threadOrdered));
 
     //std::cerr << "Before barrier 2" << '\n';
     myJobScheduler->Barrier(4);
@@ -112,84 +131,151 @@ Column * bucketifyThread(Column * rel,
         delete[] psums[i];
     }
 
-    // Calculate starting position of each bucket
-    *startingPositions = psums[0];
-    
     pthread_mutex_destroy(&memcpy_mtx);
 
-    return threadOrdered;
-}
+    if(radixPlan.passes == 1){
+        *histogram = wholeHistogram;
+        // Calculate starting position of each bucket
+        *startingPositions = psums[0];
+        return threadOrdered;
+    }
+
+    // Second pass: each partition is small enough to be refined by a single
+    // job, which writes the final histogram and psum of its sub-buckets
+    uint64_t subBuckets = (uint64_t) 1 << radixPlan.bitsPass2;
+    *histogram = new uint64_t[numberOfBuckets];
+    *startingPositions = new uint64_t[numberOfBuckets];
+    Column * refined = packed ? newPackedColumn(rel->size)
+                              : newAlignedColumn(rel->size);
+
+    for(uint64_t i=0; i<passBuckets; i++){
+        myJobScheduler->Schedule(new RefineJob(threadOrdered, psums[0][i],
+                                               wholeHistogram[i],
+                                               radixPlan.bitsPass2,
+                                               *histogram + i * subBuckets,
+                                               *startingPositions + i * subBuckets,
+                                               refined));
+    }
+    myJobScheduler->Barrier((int) passBuckets);
+
+    deleteColumn(threadOrdered);
+    delete[] wholeHistogram;
+    delete[] psums[0];
 
-void swap(uint64_t * a, uint64_t * b){
-    uint64_t temp = *a;
-    *a = *b;
-    *b = temp;
+    return refined;
 }
 
-void threadJoin(uint64_t numberOfBuckets){
-    uint64_t * bucketSize = new uint64_t[numberOfBuckets];
-    uint64_t * finalOrder = new uint64_t[numberOfBuckets];
+// A unit of join work: either a whole bucket or a slice of the bigger side
+// of a heavy bucket that is probed against a shared index
+typedef struct JoinTask{
+    uint64_t bucket;
+    uint64_t start;
+    uint64_t length;
+    uint64_t work;
+    bool shared;
+} JoinTask;
+
+static bool heavierTask(const JoinTask & a, const JoinTask & b){
+    return a.work > b.work;
+}
 
+// Schedules the join of every bucket and returns its output. Buckets whose
+// bigger side exceeds the fair share of a thread get their index built first
+// and their probe side split in several jobs, so a skewed bucket does not
+// keep one worker busy while the others wait at the barrier. Every job runs
+// twice: once to count its matches and, after a prefix sum over the counts,
+// once to write them at its own offset of the output
+JoinResult * threadJoin(uint64_t numberOfBuckets){
+    uint64_t totalWork = 0;
     for(uint64_t i = 0; i < numberOfBuckets; i++){
-        finalOrder[i] = i;
-        if(globalHistA[i] > globalHistB[i])
-            bucketSize[i] = globalHistA[i];
-        else
-            bucketSize[i] = globalHistB[i];
+        if(globalHistA[i] == 0 || globalHistB[i] == 0) continue;
+        totalWork += globalHistA[i] + globalHistB[i];
     }
 
-    uint64_t swaps;
-    for(uint64_t j=0; j<numberOfBuckets-2; j++){
-        swaps = 0;
-        for(uint64_t j=0; j<numberOfBuckets-1; j++){
-            if(bucketSize[j] < bucketSize[j+1]){
-                swap(&bucketSize[j], &bucketSize[j+1]);
-                swap(&finalOrder[j], &finalOrder[j+1]);
-                swaps++;
-            }
-        }
-        if(swaps == 0) break;
-    }
+    uint64_t chunk = totalWork / (4 * SKEW_SPLIT_FACTOR);
+    if(chunk < MIN_PROBE_CHUNK) chunk = MIN_PROBE_CHUNK;
 
-    for(uint64_t i = 0; i < numberOfBuckets; i++){
-        myJobScheduler->Schedule(new JoinJob(finalOrder[i]));
-    }
+    std::vector<JoinTask> tasks;
+    uint64_t heavyBuckets = 0;
+    globalIndexes = new HashIndex*[numberOfBuckets];
+    for(uint64_t i = 0; i < numberOfBuckets; i++)
+        globalIndexes[i] = NULL;
 
-    delete[] bucketSize;
-    delete[] finalOrder;
+    for(uint64_t i = 0; i < numberOfBuckets; i++){
+        //the one bucket is empty so there is nothing to compare with
+        //the other bucket
+        if(globalHistA[i] == 0 || globalHistB[i] == 0) continue;
 
-    myJobScheduler->Barrier((int) numberOfBuckets);
-}
+        bool buildOnB = globalHistA[i] >= globalHistB[i];
+        uint64_t probeSize = buildOnB ? globalHistA[i] : globalHistB[i];
+        uint64_t probeStart = buildOnB ? globalPsumA[i] : globalPsumB[i];
 
-Result ** convertResult(uint64_t numberOfBuckets){
-    Result ** result = new Result*[2];
-    result[0] = newResult();
-    result[1] = newResult();
+        if(probeSize <= chunk){
+            JoinTask task = {i, 0, 0, globalHistA[i] + globalHistB[i], false};
+            tasks.push_back(task);
+            continue;
+        }
 
-    for (uint64_t i = 0; i < numberOfBuckets; i++){
-        for(uint64_t j=0; j<globalResults[i][0]->totalEntries; j++){
-            insertSingleResult(result[0], getSingleEntry(globalResults[i][0],j));
+        myJobScheduler->Schedule(new BuildJob(i));
+        heavyBuckets++;
+        for(uint64_t j = 0; j < probeSize; j += chunk){
+            uint64_t length = probeSize - j < chunk ? probeSize - j : chunk;
+            JoinTask task = {i, probeStart + j, length, length, true};
+            tasks.push_back(task);
         }
-        for(uint64_t j=0; j<globalResults[i][1]->totalEntries; j++){
-            insertSingleResult(result[1], getSingleEntry(globalResults[i][1],j));
+    }
+
+    // Every probe job of a heavy bucket needs its index
+    if(heavyBuckets > 0)
+        myJobScheduler->Barrier((int) heavyBuckets);
+
+    // Largest jobs first, so the small ones fill in at the end
+    std::stable_sort(tasks.begin(), tasks.end(), heavierTask);
+
+    globalOutput = NULL;
+    globalOffsets = new uint64_t[tasks.size()]();
+    for(int pass = 0; pass < 2; pass++){
+        for(uint64_t i = 0; i < tasks.size(); i++){
+            if(tasks[i].shared)
+                myJobScheduler->Schedule(new ProbeJob(tasks[i].bucket, tasks[i].start,
+                                                      tasks[i].length, i));
+            else
+                myJobScheduler->Schedule(new JoinJob(tasks[i].bucket, i));
         }
+
+        myJobScheduler->Barrier((int) tasks.size());
+        if(pass == 0)
+            globalOutput = allocateJoinOutput(globalOffsets, tasks.size());
     }
+
+    JoinResult * result = globalOutput;
+    globalOutput = NULL;
+    delete[] globalOffsets;
+
+    for(uint64_t i = 0; i < numberOfBuckets; i++)
+        deleteHashIndex(globalIndexes[i]);
+    delete[] globalIndexes;
+
     return result;
 }
 
-void calculateThreadHistogram( uint64_t * start, uint64_t length, uint64_t * histogram ){
+void calculateThreadHistogram( uint64_t * start, uint64_t length,
+                               uint64_t * histogram, uint64_t shift,
+                               uint64_t mask ){
 
     // Add up the number of tuples in each bucket
     for(uint64_t i=0; i<length; i++)
-        histogram[h1(start[i])]++;
+        histogram[h1Radix(start[i], shift, mask)]++;
 
     return;
 
 }
 
 HistogramJob::HistogramJob( uint64_t * curStart, uint64_t curLength,
-                            uint64_t ** curGlobalPos)
-:start(curStart),length(curLength),myHistogram(curGlobalPos)
+                            uint64_t ** curGlobalPos, uint64_t curShift,
+                            uint64_t curCount)
+:start(curStart),length(curLength),myHistogram(curGlobalPos),
+ shift(curShift),bucketCount(curCount)
 {
     //std::cerr << "A HistogramJob is created!" << '\n';
 }
@@ -201,7 +287,7 @@ HistogramJob::~HistogramJob(){
 uint64_t HistogramJob::Run(){
     //std::cerr << "A HistogramJob is running!" << '\n';
 
-    calculateThreadHistogram(start,length,*myHistogram);
+    calculateThreadHistogram(start,length,*myHistogram,shift,bucketCount-1);
 
     return 1;
 }
@@ -209,40 +295,152 @@ uint64_t HistogramJob::Run(){
 PartitionJob::PartitionJob( Column * curOriginal,
                             uint64_t  curStart,uint64_t curLength,
                             uint64_t * curPsum, uint64_t curCount,
-                            Column * curOrdered)
-:original(curOriginal), start(curStart), length(curLength), myPsum(curPsum), bucketCount(curCount), ordered(curOrdered){
+                            uint64_t curShift, Column * curOrdered)
+:original(curOriginal), start(curStart), length(curLength), myPsum(curPsum), bucketCount(curCount), shift(curShift), ordered(curOrdered){
 }
 
 PartitionJob::~PartitionJob(){
     //std::cerr << "A PartitionJob is destroyed!" << '\n';
 }
 
+// Software write-combining buffer of one partition. Tuples are staged here
+// until a whole cache line of values and of rowids can be written at once
+typedef struct WCBuffer{
+    uint64_t value[LINE_ENTRIES];
+    uint64_t rowid[LINE_ENTRIES];
+} __attribute__((aligned(CACHE_LINE_SIZE))) WCBuffer;
+
+// Write the slots [from, to) of a buffered line whose first slot maps to
+// position 'base' of the output. Used for lines this job does not own whole
+static void flushPartialLine(WCBuffer * buffer, Column * ordered,
+                             uint64_t base, uint64_t from, uint64_t to){
+    for(uint64_t j=from; j<to; j++){
+        ordered->value[base + j] = buffer->value[j];
+        if(!isPacked(ordered))
+            ordered->rowid[base + j] = buffer->rowid[j];
+    }
+}
+
 uint64_t PartitionJob::Run(){
 
-    uint64_t * offsets = new uint64_t[bucketCount];
+    uint64_t * offsets = poolAlloc(bucketCount);
     pthread_mutex_lock(&memcpy_mtx);
     memcpy(offsets, myPsum, bucketCount * sizeof(uint64_t));
     pthread_mutex_unlock(&memcpy_mtx);
 
+    // The first position of every partition that belongs to this job. Lines
+    // that start before it are shared with another partition or job and must
+    // not be overwritten whole
+    uint64_t * begin = poolAlloc(bucketCount);
+    memcpy(begin, offsets, bucketCount * sizeof(uint64_t));
+
+    // Pool buffers are cache line aligned like the WCBuffers need
+    WCBuffer * buffers = (WCBuffer *) poolAlloc(bucketCount * sizeof(WCBuffer)
+                                                / sizeof(uint64_t));
+    LineFlush flushLine = selectLineFlush();
+    bool packed = isPacked(ordered);
+
+    uint64_t mask = bucketCount - 1;
     for(uint64_t i=start; i<start+length; i++){
         uint64_t val = original->value[i];
-
-        // Store value & rowid of Tuple in the appropriate position
-        ordered->value[offsets[h1(val)]] = val;
-        ordered->rowid[offsets[h1(val)]] = original->rowid[i];
+        uint64_t bucket = h1Radix(val, shift, mask);
+        uint64_t pos = offsets[bucket];
+        WCBuffer * buffer = &buffers[bucket];
+
+        // Stage value & rowid of Tuple in the slot of its final position.
+        // A packed output only needs the line of values
+        if(packed){
+            buffer->value[pos % LINE_ENTRIES] = packTuple(val, original->rowid[i]);
+        }
+        else{
+            buffer->value[pos % LINE_ENTRIES] = val;
+            buffer->rowid[pos % LINE_ENTRIES] = original->rowid[i];
+        }
 
         // Increment starting position of the bucket since we just added to it
-        offsets[h1(val)]++;
+        pos++;
+        offsets[bucket] = pos;
+
+        // Once the line is complete write it to the ordered Column
+        if(pos % LINE_ENTRIES == 0){
+            uint64_t base = pos - LINE_ENTRIES;
+            if(base >= begin[bucket]){
+                flushLine(ordered->value + base, buffer->value);
+                if(!packed)
+                    flushLine(ordered->rowid + base, buffer->rowid);
+            }
+            else{
+                flushPartialLine(buffer, ordered, base,
+                                 begin[bucket] - base, LINE_ENTRIES);
+            }
+        }
+    }
+
+    // Write what is left in the buffers of incomplete lines
+    for(uint64_t i=0; i<bucketCount; i++){
+        uint64_t pos = offsets[i];
+        if(pos % LINE_ENTRIES == 0) continue;
+        uint64_t base = pos - pos % LINE_ENTRIES;
+        uint64_t from = begin[i] > base ? begin[i] - base : 0;
+        flushPartialLine(&buffers[i], ordered, base, from, pos - base);
+    }
+    storeFence();
+
+    poolFree((uint64_t *) buffers);
+    poolFree(begin);
+    poolFree(offsets);
+
+    return 1;
+}
+
+RefineJob::RefineJob( Column * curOriginal,
+                      uint64_t curStart, uint64_t curLength,
+                      uint64_t curBits, uint64_t * curHistogram,
+                      uint64_t * curPsum, Column * curOrdered)
+:original(curOriginal), start(curStart), length(curLength), bits(curBits),
+ histogram(curHistogram), psum(curPsum), ordered(curOrdered){
+}
+
+RefineJob::~RefineJob(){
+}
+
+uint64_t RefineJob::Run(){
+    uint64_t bucketCount = (uint64_t) 1 << bits;
+    uint64_t mask = bucketCount - 1;
+
+    for(uint64_t i=0; i<bucketCount; i++)
+        histogram[i] = 0;
+    for(uint64_t i=start; i<start+length; i++)
+        histogram[h1Radix(original->value[i], 0, mask)]++;
+
+    // Sub-buckets start where the partition of the first pass started
+    psum[0] = start;
+    for(uint64_t i=1; i<bucketCount; i++)
+        psum[i] = psum[i-1] + histogram[i-1];
+
+    uint64_t * offsets = poolAlloc(bucketCount);
+    memcpy(offsets, psum, bucketCount * sizeof(uint64_t));
+
+    for(uint64_t i=start; i<start+length; i++){
+        uint64_t val = original->value[i];
+        uint64_t bucket = h1Radix(val, 0, mask);
+
+        // Packed tuples carry their rowid in the value
+        ordered->value[offsets[bucket]] = val;
+        if(!isPacked(ordered))
+            ordered->rowid[offsets[bucket]] = original->rowid[i];
+        offsets[bucket]++;
     }
 
-    delete[] offsets;
+    poolFree(offsets);
 
     return 1;
 }
 
-JoinJob::JoinJob(uint64_t bucketNumber)
+JoinJob::JoinJob(uint64_t bucketNumber, uint64_t slot)
 {
     this->bucketNumber = bucketNumber;
+    this->resultSlot = slot;
     //std::cerr << "A JoinJob is created!" << '\n';
 }
 
@@ -250,36 +448,426 @@ JoinJob::~JoinJob(){
 }
 
 uint64_t JoinJob::Run(){
-    uint64_t * bucketArray;
-    uint64_t * chainArray;
+    uint64_t i = bucketNumber;
+
+    // For each bucket find the smaller one and make an index with h2 for
+    // that one. The counting pass builds it and the writing pass reuses it
+    bool flag = globalHistA[i] < globalHistB[i];
+    if (globalIndexes[i] == NULL) {
+        if (flag == 0)
+            globalIndexes[i] = buildHashIndex(orderedB, globalHistB[i], globalPsumB[i]);
+        else
+            globalIndexes[i] = buildHashIndex(orderedA, globalHistA[i], globalPsumA[i]);
+    }
 
-    Result *** result = &globalResults[bucketNumber];
-    *result = new Result*[2];
-    (*result)[0] = newResult();
-    (*result)[1] = newResult();
+    // Then find the equal values and store them in the output
+    JoinCursor cursor = newJoinCursor(globalOutput, flag, globalOffsets[resultSlot]);
+    if (flag == 0)
+        compare(orderedA, globalHistA[i], globalPsumA[i], globalIndexes[i], &cursor);
+    else
+        compare(orderedB, globalHistB[i], globalPsumB[i], globalIndexes[i], &cursor);
+
+    // The index is not needed after the writing pass. Freeing it here
+    // returns its buffers to the pool of this worker
+    if (globalOutput == NULL) {
+        globalOffsets[resultSlot] = cursor.pos;
+    }
+    else {
+        deleteHashIndex(globalIndexes[i]);
+        globalIndexes[i] = NULL;
+    }
 
+    return 1;
+}
+
+AggregateJob::AggregateJob(uint64_t bucketNumber, AggregateSum * curRequested,
+                           uint64_t curSumsCount, uint64_t * curWeights,
+                           uint64_t * curSums)
+:bucketNumber(bucketNumber), requested(curRequested),
+ sumsCount(curSumsCount), weights(curWeights), sums(curSums){
+}
+
+AggregateJob::~AggregateJob(){
+}
+
+uint64_t AggregateJob::Run(){
+    HashIndex * index;
     uint64_t i = bucketNumber;
 
-    if(globalHistA[i] == 0 || globalHistB[i] == 0){
-        //the one bucket is empty so there is nothing to compare with
-        //the other bucket
-        return 0;
-    }
-    // For each bucket find the smaller one and make an index with h2 for
-    // that one. Then find the equal values and store them in result
+    // The index is made for the smaller side, as in JoinJob
     if (globalHistA[i] >= globalHistB[i]) {
-        bucketify2(orderedB, globalHistB[i], globalPsumB[i], &bucketArray, &chainArray);
-        compare(orderedA, orderedB, globalHistA[i], globalPsumA[i], globalHistB[i], \
-            globalPsumB[i], bucketArray, chainArray, (*result), 0);
+        index = buildHashIndex(orderedB, globalHistB[i], globalPsumB[i]);
+        aggregateProbe(orderedA, globalHistA[i], globalPsumA[i], index, 0,
+                       requested, sumsCount, weights, sums);
     }
     else {
-        bucketify2(orderedA, globalHistA[i], globalPsumA[i], &bucketArray, &chainArray);
-        compare(orderedB, orderedA, globalHistB[i], globalPsumB[i], globalHistA[i], \
-            globalPsumA[i], bucketArray, chainArray, (*result), 1);
+        index = buildHashIndex(orderedA, globalHistA[i], globalPsumA[i]);
+        aggregateProbe(orderedB, globalHistB[i], globalPsumB[i], index, 1,
+                       requested, sumsCount, weights, sums);
     }
 
-    delete[] bucketArray;
-    delete[] chainArray;
+    deleteHashIndex(index);
+
+    return 1;
+}
+
+BuildJob::BuildJob(uint64_t bucketNumber)
+{
+    this->bucketNumber = bucketNumber;
+}
+
+BuildJob::~BuildJob(){
+}
+
+uint64_t BuildJob::Run(){
+    uint64_t i = bucketNumber;
+
+    // The index is always made for the smaller side, as in JoinJob
+    if (globalHistA[i] >= globalHistB[i])
+        globalIndexes[i] = buildHashIndex(orderedB, globalHistB[i], globalPsumB[i]);
+    else
+        globalIndexes[i] = buildHashIndex(orderedA, globalHistA[i], globalPsumA[i]);
+
+    return 1;
+}
+
+ProbeJob::ProbeJob(uint64_t bucketNumber, uint64_t curStart,
+                   uint64_t curLength, uint64_t slot)
+:bucketNumber(bucketNumber), start(curStart), length(curLength),
+ resultSlot(slot){
+}
+
+ProbeJob::~ProbeJob(){
+}
+
+uint64_t ProbeJob::Run(){
+    uint64_t i = bucketNumber;
+    HashIndex * index = globalIndexes[i];
+    bool flag = globalHistA[i] < globalHistB[i];
+    JoinCursor cursor = newJoinCursor(globalOutput, flag, globalOffsets[resultSlot]);
+
+    // 'start' and 'length' describe a slice of the bigger side
+    if (flag == 0)
+        compare(orderedA, length, start, index, &cursor);
+    else
+        compare(orderedB, length, start, index, &cursor);
+
+    if (globalOutput == NULL)
+        globalOffsets[resultSlot] = cursor.pos;
+
+    return 1;
+}
+
+SharedProbeJob::SharedProbeJob(Column * curBig, uint64_t curStart,
+                               uint64_t curLength, HashIndex * curIndex,
+                               bool curFlag, uint64_t slot)
+:big(curBig), start(curStart), length(curLength), index(curIndex),
+ flag(curFlag), resultSlot(slot){
+}
+
+SharedProbeJob::~SharedProbeJob(){
+}
+
+uint64_t SharedProbeJob::Run(){
+    JoinCursor cursor = newJoinCursor(globalOutput, flag, globalOffsets[resultSlot]);
+    compare(big, length, start, index, &cursor);
+
+    if (globalOutput == NULL)
+        globalOffsets[resultSlot] = cursor.pos;
+
+    return 1;
+}
+
+DirectProbeJob::DirectProbeJob(Column * curBig, uint64_t curStart,
+                               uint64_t curLength, DirectIndex * curIndex,
+                               bool curFlag, uint64_t slot)
+:big(curBig), start(curStart), length(curLength), index(curIndex),
+ flag(curFlag), resultSlot(slot){
+}
+
+DirectProbeJob::~DirectProbeJob(){
+}
+
+uint64_t DirectProbeJob::Run(){
+    JoinCursor cursor = newJoinCursor(globalOutput, flag, globalOffsets[resultSlot]);
+    directProbe(big, length, start, index, &cursor);
+
+    if (globalOutput == NULL)
+        globalOffsets[resultSlot] = cursor.pos;
+
+    return 1;
+}
+
+BloomScanJob::BloomScanJob(BloomFilter * curFilter, uint64_t * curValues,
+                           uint64_t curStart, uint64_t curLength,
+                           Column * curOut, uint64_t * curKept)
+:filter(curFilter), values(curValues), start(curStart), length(curLength),
+ out(curOut), kept(curKept){
+}
+
+BloomScanJob::~BloomScanJob(){
+}
+
+uint64_t BloomScanJob::Run(){
+    *kept = bloomScan(filter, values, start, length, out);
+    return 1;
+}
+
+GatherIRJob::GatherIRJob(uint64_t ** curFrom, uint64_t ** curTo,
+                         uint64_t curColumns, uint64_t * curSelection,
+                         uint64_t * curRows, uint64_t curStart,
+                         uint64_t curLength)
+:from(curFrom), to(curTo), columns(curColumns), selection(curSelection),
+ rows(curRows), start(curStart), length(curLength){
+}
+
+GatherIRJob::~GatherIRJob(){
+}
+
+uint64_t GatherIRJob::Run(){
+    uint64_t end = start + length;
+
+    // One pass over the row indexes serves every column. The old columns
+    // are read at random, so their rows are prefetched ahead of time
+    uint64_t distance = gatherPrefetchDistance;
+    uint64_t i = start;
+    for(; distance < end - i; i++){
+        uint64_t row = rows[i];
+        uint64_t ahead = rows[i + distance];
+        if(selection != NULL){
+            row = selection[row];
+            ahead = selection[ahead];
+        }
+        for(uint64_t c=0; c<columns; c++){
+            __builtin_prefetch(from[c] + ahead);
+            to[c][i] = from[c][row];
+        }
+    }
+    for(; i < end; i++){
+        uint64_t row = selection == NULL ? rows[i] : selection[rows[i]];
+        for(uint64_t c=0; c<columns; c++)
+            to[c][i] = from[c][row];
+    }
+
+    return 1;
+}
+
+ValueGatherJob::ValueGatherJob(uint64_t * curValues, uint64_t * curRowids,
+                               uint64_t * curSelection, uint64_t * curWeights,
+                               uint64_t curStart, uint64_t curLength,
+                               uint64_t * curOut, uint64_t * curSum)
+:values(curValues), rowids(curRowids), selection(curSelection),
+ weights(curWeights), start(curStart), length(curLength), out(curOut),
+ sum(curSum){
+}
+
+ValueGatherJob::~ValueGatherJob(){
+}
+
+uint64_t ValueGatherJob::Run(){
+    // Writing: the rowids of a selection are gathered in place first
+    if(out != NULL){
+        uint64_t * to = out + start;
+        if(selection == NULL){
+            gatherKernel(to, values, rowids + start, length);
+        }
+        else{
+            gatherKernel(to, rowids, selection + start, length);
+            gatherKernel(to, values, to, length);
+        }
+        return 1;
+    }
+
+    // Summing: one block of values at a time
+    uint64_t index[GATHER_BLOCK];
+    uint64_t block[GATHER_BLOCK];
+    uint64_t total = 0;
+    for(uint64_t b=start; b<start+length; b+=GATHER_BLOCK){
+        uint64_t n = b + GATHER_BLOCK > start + length ? start + length - b
+                                                       : GATHER_BLOCK;
+        uint64_t * rows = rowids + b;
+        if(selection != NULL){
+            gatherKernel(index, rowids, selection + b, n);
+            rows = index;
+        }
+        gatherKernel(block, values, rows, n);
+
+        if(weights == NULL){
+            for(uint64_t k=0; k<n; k++)
+                total += block[k];
+        }
+        else{
+            for(uint64_t k=0; k<n; k++){
+                uint64_t row = selection == NULL ? b + k : selection[b + k];
+                total += weights[row] * block[k];
+            }
+        }
+    }
+    *sum = total;
+
+    return 1;
+}
+
+FilterJob::FilterJob(FilterTerm * curTerms, uint64_t curTermsCount,
+                     uint64_t * curRowids, uint64_t * curSelection,
+                     uint64_t curStart, uint64_t curLength, uint64_t * curOut,
+                     uint64_t * curSlot)
+:terms(curTerms), termsCount(curTermsCount), rowids(curRowids),
+ selection(curSelection), start(curStart), length(curLength), out(curOut),
+ slot(curSlot){
+}
+
+FilterJob::~FilterJob(){
+}
+
+uint64_t FilterJob::Run(){
+    if(termsCount == 0){
+        if(out == NULL)
+            *slot = length;
+        else
+            for(uint64_t i=0; i<length; i++)
+                out[*slot + i] = start + i;
+        return 1;
+    }
+
+    // A single term over the table needs no staging
+    if(termsCount == 1 && rowids == NULL){
+        if(out == NULL)
+            *slot = filterKernel(terms[0].values, start, length,
+                                 terms[0].value, terms[0].op, NULL);
+        else
+            filterKernel(terms[0].values, start, length, terms[0].value,
+                         terms[0].op, out + *slot);
+        return 1;
+    }
+
+    uint64_t tuples[FILTER_BLOCK];
+    uint64_t values[FILTER_BLOCK];
+    uint64_t kept[FILTER_BLOCK];
+    uint64_t total = 0;
+
+    for(uint64_t b=start; b<start+length; b+=FILTER_BLOCK){
+        uint64_t n = b + FILTER_BLOCK < start + length ? FILTER_BLOCK
+                                                       : start + length - b;
+        // Positions in 'kept' are relative to the block
+        uint64_t * tuple = NULL;
+        uint64_t count;
+        if(rowids == NULL){
+            count = filterKernel(terms[0].values + b, 0, n, terms[0].value,
+                                 terms[0].op, kept);
+        }
+        else{
+            tuple = rowids + b;
+            if(selection != NULL){
+                gatherKernel(tuples, rowids, selection + b, n);
+                tuple = tuples;
+            }
+            gatherKernel(values, terms[0].values, tuple, n);
+            count = filterKernel(values, 0, n, terms[0].value, terms[0].op,
+                                 kept);
+        }
+
+        for(uint64_t t=1; t<termsCount && count > 0; t++)
+            count = refinePositions(tuple == NULL ? terms[t].values + b
+                                                  : terms[t].values,
+                                    tuple, kept, count, terms[t].value,
+                                    terms[t].op);
+
+        if(out != NULL)
+            for(uint64_t i=0; i<count; i++)
+                out[*slot + total + i] = b + kept[i];
+        total += count;
+    }
+
+    if(out == NULL)
+        *slot = total;
+    return 1;
+}
+
+LoadJob::LoadJob(const char * curPath, Relation * curRelation)
+:path(curPath), relation(curRelation){
+}
+
+LoadJob::~LoadJob(){
+}
+
+uint64_t LoadJob::Run(){
+    *relation = mapFile(path);
+    return 1;
+}
+
+StatsJob::StatsJob(uint64_t * curValues, uint64_t curStart,
+                   uint64_t curLength, uint64_t curZoneRows,
+                   uint64_t * curZoneMin, uint64_t * curZoneMax,
+                   uint8_t * curRegisters)
+:values(curValues), start(curStart), length(curLength),
+ zoneRows(curZoneRows), zoneMin(curZoneMin), zoneMax(curZoneMax),
+ registers(curRegisters){
+}
+
+StatsJob::~StatsJob(){
+}
+
+uint64_t StatsJob::Run(){
+    for(uint64_t b=start, k=0; b<start+length; b+=zoneRows, k++){
+        uint64_t end = b + zoneRows < start + length ? b + zoneRows
+                                                     : start + length;
+        uint64_t min = values[b];
+        uint64_t max = values[b];
+        for(uint64_t i=b+1; i<end; i++){
+            if(values[i] < min) min = values[i];
+            if(values[i] > max) max = values[i];
+        }
+        zoneMin[k] = min;
+        zoneMax[k] = max;
+        // Sketched while the zone is still in the cache
+        hllAdd(registers, values + b, end - b);
+    }
+    return 1;
+}
+
+SampleJob::SampleJob(uint64_t * curValues, uint64_t curRows,
+                     Histogram * curHistogram)
+:values(curValues), rows(curRows), histogram(curHistogram){
+}
+
+SampleJob::~SampleJob(){
+}
+
+uint64_t SampleJob::Run(){
+    buildHistogram(values, rows, histogram);
+    return 1;
+}
+
+SortJob::SortJob(Column * curOriginal, Column * curSorted, uint64_t curStart,
+                 uint64_t curLength)
+:original(curOriginal), sorted(curSorted), start(curStart), length(curLength){
+}
+
+SortJob::~SortJob(){
+}
+
+uint64_t SortJob::Run(){
+    radixSortRun(original, sorted, start, length);
+    return 1;
+}
+
+MergeJob::MergeJob(Column * curA, uint64_t curStartA, uint64_t curLengthA,
+                   Column * curB, uint64_t curStartB, uint64_t curLengthB,
+                   uint64_t slot)
+:A(curA), startA(curStartA), lengthA(curLengthA),
+ B(curB), startB(curStartB), lengthB(curLengthB), resultSlot(slot){
+}
+
+MergeJob::~MergeJob(){
+}
+
+uint64_t MergeJob::Run(){
+    JoinCursor cursor = newJoinCursor(globalOutput, 0, globalOffsets[resultSlot]);
+    mergeRuns(A, startA, lengthA, B, startB, lengthB, &cursor);
+
+    if (globalOutput == NULL)
+        globalOffsets[resultSlot] = cursor.pos;
 
     return 1;
 }
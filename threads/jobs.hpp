@@ -4,17 +4,31 @@
 #include <iostream>
 #include "../singleJoin/structs.hpp"
 #include "../singleJoin/h1.hpp"
+#include "../singleJoin/h2.hpp"
 #include "../singleJoin/result.hpp"
+#include "../singleJoin/bloom.hpp"
+#include "../singleJoin/direct.hpp"
+#include "../singleJoin/aggregate.hpp"
+#include "../singleJoin/sketch.hpp"
+#include "../join/memmap.hpp"
 
 extern uint64_t numberOfBuckets;
 
-void calculateThreadHistogram(uint64_t * start, uint64_t length, uint64_t * histogram);
+void calculateThreadHistogram(uint64_t * start, uint64_t length,
+                              uint64_t * histogram, uint64_t shift,
+                              uint64_t mask);
 Column * bucketifyThread(Column * rel,
                   uint64_t ** histogram,
-                  uint64_t ** startingPositions);
+                  uint64_t ** startingPositions,
+                  bool packed);
 
-void threadJoin(uint64_t);
-Result ** convertResult(uint64_t numberOfBuckets);
+// A bucket is split into several probe jobs when its probe side is larger
+// than 1/SKEW_SPLIT_FACTOR of the work each thread would get on average.
+// Probe jobs are never made smaller than MIN_PROBE_CHUNK tuples
+#define SKEW_SPLIT_FACTOR 4
+#define MIN_PROBE_CHUNK 16384
+
+JoinResult * threadJoin(uint64_t);
 
 // Abstract Class Job
 class Job {
@@ -33,9 +47,12 @@ class HistogramJob : public Job{
     uint64_t * start;
     uint64_t length;
     uint64_t ** myHistogram;
+    uint64_t shift;
+    uint64_t bucketCount;
 public:
     HistogramJob( uint64_t * curStart, uint64_t curLength,
-                  uint64_t ** curGlobalPos);
+                  uint64_t ** curGlobalPos, uint64_t curShift,
+                  uint64_t curCount);
     ~HistogramJob();
     uint64_t Run();
 };
@@ -46,21 +63,280 @@ class PartitionJob : public Job{
     uint64_t length;
     uint64_t * myPsum;
     uint64_t bucketCount;
+    uint64_t shift;
     Column * ordered;
 
 public:
     PartitionJob(Column * curOriginal, uint64_t curStart, uint64_t curLength,
-                 uint64_t * myPsum, uint64_t curCount, Column * curOrdered);
+                 uint64_t * myPsum, uint64_t curCount, uint64_t curShift,
+                 Column * curOrdered);
     ~PartitionJob();
     uint64_t Run();
 };
 
+// Second partitioning pass. Splits one partition of the first pass on the
+// low bits of the radix and fills its slice of the final histogram and psum
+class RefineJob : public Job{
+    Column * original;
+    uint64_t start;
+    uint64_t length;
+    uint64_t bits;
+    uint64_t * histogram;
+    uint64_t * psum;
+    Column * ordered;
+
+public:
+    RefineJob(Column * curOriginal, uint64_t curStart, uint64_t curLength,
+              uint64_t curBits, uint64_t * curHistogram, uint64_t * curPsum,
+              Column * curOrdered);
+    ~RefineJob();
+    uint64_t Run();
+};
+
 class JoinJob : public Job{
     uint64_t bucketNumber;
+    uint64_t resultSlot;
 public:
-    JoinJob( uint64_t x );
+    JoinJob( uint64_t x, uint64_t slot );
     ~JoinJob();
     uint64_t Run();
 };
 
+// Joins a bucket and adds its matches to the requested sums, without
+// producing any result pairs
+class AggregateJob : public Job{
+    uint64_t bucketNumber;
+    AggregateSum * requested;
+    uint64_t sumsCount;
+    uint64_t * weights;
+    uint64_t * sums;
+public:
+    AggregateJob( uint64_t x, AggregateSum * curRequested,
+                  uint64_t curSumsCount, uint64_t * curWeights,
+                  uint64_t * curSums );
+    ~AggregateJob();
+    uint64_t Run();
+};
+
+// Builds the shared h2 index of a heavy bucket
+class BuildJob : public Job{
+    uint64_t bucketNumber;
+public:
+    BuildJob( uint64_t x );
+    ~BuildJob();
+    uint64_t Run();
+};
+
+// Probes a slice of the bigger side of a heavy bucket against its shared index
+class ProbeJob : public Job{
+    uint64_t bucketNumber;
+    uint64_t start;
+    uint64_t length;
+    uint64_t resultSlot;
+public:
+    ProbeJob( uint64_t x, uint64_t curStart, uint64_t curLength,
+              uint64_t slot );
+    ~ProbeJob();
+    uint64_t Run();
+};
+
+// Probes a slice of the bigger side of a non-partitioned join against the
+// index of the whole smaller side
+class SharedProbeJob : public Job{
+    Column * big;
+    uint64_t start;
+    uint64_t length;
+    HashIndex * index;
+    bool flag;
+    uint64_t resultSlot;
+public:
+    SharedProbeJob( Column * curBig, uint64_t curStart, uint64_t curLength,
+                    HashIndex * curIndex, bool curFlag, uint64_t slot );
+    ~SharedProbeJob();
+    uint64_t Run();
+};
+
+// Probes a slice of the bigger side of a direct join against the array
+// index of the smaller side
+class DirectProbeJob : public Job{
+    Column * big;
+    uint64_t start;
+    uint64_t length;
+    DirectIndex * index;
+    bool flag;
+    uint64_t resultSlot;
+public:
+    DirectProbeJob( Column * curBig, uint64_t curStart, uint64_t curLength,
+                    DirectIndex * curIndex, bool curFlag, uint64_t slot );
+    ~DirectProbeJob();
+    uint64_t Run();
+};
+
+// Scans a slice of a mapped column against a Bloom filter
+class BloomScanJob : public Job{
+    BloomFilter * filter;
+    uint64_t * values;
+    uint64_t start;
+    uint64_t length;
+    Column * out;
+    uint64_t * kept;
+public:
+    BloomScanJob( BloomFilter * curFilter, uint64_t * curValues,
+                  uint64_t curStart, uint64_t curLength, Column * curOut,
+                  uint64_t * curKept );
+    ~BloomScanJob();
+    uint64_t Run();
+};
+
+// Rows of the IR handled by one GatherIRJob, ValueGatherJob or FilterJob.
+// GatherIRJob prefetches the old columns gatherPrefetchDistance rows ahead
+#define IR_MORSEL 65536
+
+// Rows a ValueGatherJob that sums its values gathers at a time
+#define GATHER_BLOCK 1024
+
+// Rewrites the rows [start, start+length) of every live IR column at once:
+// to[c][i] = from[c][rows[i]], or from[c][selection[rows[i]]] when the IR
+// has a selection
+class GatherIRJob : public Job{
+    uint64_t ** from;
+    uint64_t ** to;
+    uint64_t columns;
+    uint64_t * selection;
+    uint64_t * rows;
+    uint64_t start;
+    uint64_t length;
+public:
+    GatherIRJob( uint64_t ** curFrom, uint64_t ** curTo, uint64_t curColumns,
+                 uint64_t * curSelection, uint64_t * curRows,
+                 uint64_t curStart, uint64_t curLength );
+    ~GatherIRJob();
+    uint64_t Run();
+};
+
+// Reads values[rowids[row]] for the IR rows [start, start+length) with the
+// gather kernel. A row goes through 'selection' first when there is one.
+// The values are written to 'out' or, when it is NULL, added up into 'sum',
+// each multiplied by the weight of its row when there are 'weights'
+class ValueGatherJob : public Job{
+    uint64_t * values;
+    uint64_t * rowids;
+    uint64_t * selection;
+    uint64_t * weights;
+    uint64_t start;
+    uint64_t length;
+    uint64_t * out;
+    uint64_t * sum;
+public:
+    ValueGatherJob( uint64_t * curValues, uint64_t * curRowids,
+                    uint64_t * curSelection, uint64_t * curWeights,
+                    uint64_t curStart, uint64_t curLength,
+                    uint64_t * curOut, uint64_t * curSum );
+    ~ValueGatherJob();
+    uint64_t Run();
+};
+
+// One filter 'values op value' of a conjunctive filter
+typedef struct FilterTerm{
+    uint64_t * values;
+    uint64_t value;
+    char op;
+} FilterTerm;
+
+// Finds the rows in [start, start+length) that pass all the terms. The
+// first term runs with the filter kernel and the rest only check the rows
+// that passed it. Row i reads the column values of tuple i, or of tuple
+// rowids[i] (rowids[selection[i]] with a selection) when filtering the IR.
+// While 'out' is NULL it only counts the rows that pass into *slot,
+// afterwards it writes them from out[*slot] on. Without any terms all the
+// rows pass and no column is read
+class FilterJob : public Job{
+    FilterTerm * terms;
+    uint64_t termsCount;
+    uint64_t * rowids;
+    uint64_t * selection;
+    uint64_t start;
+    uint64_t length;
+    uint64_t * out;
+    uint64_t * slot;
+public:
+    FilterJob( FilterTerm * curTerms, uint64_t curTermsCount,
+               uint64_t * curRowids, uint64_t * curSelection,
+               uint64_t curStart, uint64_t curLength, uint64_t * curOut,
+               uint64_t * curSlot );
+    ~FilterJob();
+    uint64_t Run();
+};
+
+// Maps one relation file into 'relation'
+class LoadJob : public Job{
+    const char * path;
+    Relation * relation;
+public:
+    LoadJob( const char * curPath, Relation * curRelation );
+    ~LoadJob();
+    uint64_t Run();
+};
+
+// Gathers the load-time stats of the rows [start, start+length) of a column:
+// the minimum and maximum of each block of 'zoneRows' rows in zoneMin[k]
+// and zoneMax[k], and a sketch of their distinct values in 'registers'
+class StatsJob : public Job{
+    uint64_t * values;
+    uint64_t start;
+    uint64_t length;
+    uint64_t zoneRows;
+    uint64_t * zoneMin;
+    uint64_t * zoneMax;
+    uint8_t * registers;
+public:
+    StatsJob( uint64_t * curValues, uint64_t curStart, uint64_t curLength,
+              uint64_t curZoneRows, uint64_t * curZoneMin,
+              uint64_t * curZoneMax, uint8_t * curRegisters );
+    ~StatsJob();
+    uint64_t Run();
+};
+
+// Builds the histogram and most common values of a column from a sample
+class SampleJob : public Job{
+    uint64_t * values;
+    uint64_t rows;
+    Histogram * histogram;
+public:
+    SampleJob( uint64_t * curValues, uint64_t curRows,
+               Histogram * curHistogram );
+    ~SampleJob();
+    uint64_t Run();
+};
+
+// Sorts one run of a sort-merge join input
+class SortJob : public Job{
+    Column * original;
+    Column * sorted;
+    uint64_t start;
+    uint64_t length;
+public:
+    SortJob( Column * curOriginal, Column * curSorted, uint64_t curStart,
+             uint64_t curLength );
+    ~SortJob();
+    uint64_t Run();
+};
+
+// Merge joins one sorted run of A with one sorted run of B
+class MergeJob : public Job{
+    Column * A;
+    uint64_t startA;
+    uint64_t lengthA;
+    Column * B;
+    uint64_t startB;
+    uint64_t lengthB;
+    uint64_t resultSlot;
+public:
+    MergeJob( Column * curA, uint64_t curStartA, uint64_t curLengthA,
+              Column * curB, uint64_t curStartB, uint64_t curLengthB,
+              uint64_t slot );
+    ~MergeJob();
+    uint64_t Run();
+};
+
 #endif /* JOBS_H */